@@ -0,0 +1,245 @@
+/*
+MRPrimes - a program to generate large prime numbers using the Miller-Rabin probabalistic
+primality test implemented with the GNU Multiple Precision math library and POSIX threads.
+Copyright (C) 2012, 2013 Evan Brown
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* This file builds the MRPrimes library, declared in mrprimes.h, from the same sources as the program, with its main left out:
+	gcc -std=c11 -O3 -c libmrprimes.c && ar rcs libmrprimes.a libmrprimes.o
+The program's functions which the library does not use are still compiled in, so warnings about them are turned off. */
+
+#define MRPRIMES_LIBRARY
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include "mrprimes.c"
+#pragma GCC diagnostic pop
+#include "mrprimes.h"
+
+/* Defaults of the arguments of mrprimes_create, and the size of the candidates which the scratch of mrprimes_is_probable_prime
+is first allocated for. */
+enum library_defaults {DEFAULT_OFFSETS = 10000, DEFAULT_ROUNDS = 8, DEFAULT_TEST_BITS = 1024};
+
+/* The following structure is the generator context. The workers wait on start for a request, which they find in request,
+and post done once they have found their share of its primes. A request of NULL tells them to exit. The requests and tests
+of a context poll its own stop flag, which nothing sets, so that they are not stopped with the program's searches or another
+context's. */
+struct mrprimes_ctx
+{
+	struct offset_table_t table;
+	int rounds;
+	uint64_t seed;
+	uint64_t next_stream; // index of the first random stream not used by earlier requests
+	atomic_ullong next_test; // number of calls to mrprimes_is_probable_prime, which take their streams from the top of the range
+	long num_threads;
+	pthread_t *threads;
+	pthread_mutex_t request_lock; // held while a request is served
+	pthread_mutex_t callback_lock; // held while the callback is called
+	sem_t start;
+	sem_t done;
+	struct thread_data_t *request;
+	mrprimes_callback callback;
+	void *arg;
+	atomic_int stop;
+	pthread_mutex_t test_lock; // held while a test uses the scratch and random state of the context
+	struct scratch_t test_scratch;
+	gmp_randstate_t test_random;
+	mp_bitcnt_t test_bits; // size of the candidates which test_scratch is allocated for
+};
+
+/* This method defines the behavior of each worker thread of a context: serve requests until told to exit. The state of the
+worker is kept between requests, and only allocated again when a request needs larger primes than any before it. */
+static void *
+serve_requests (void *ctx_arg)
+{
+	mrprimes_ctx *ctx = (mrprimes_ctx *)ctx_arg;
+	struct worker_t worker;
+	mp_bitcnt_t capacity = 0; // max_bits the worker was allocated for, or 0 if it has not been allocated
+	for (;;)
+	{
+		while (sem_wait (&ctx->start))
+			continue; // interrupted by a signal
+		struct thread_data_t *request = ctx->request;
+		if (!request)
+			break;
+		if (request->max_bits > capacity)
+		{
+			if (capacity)
+				worker_clear (&worker);
+			worker_init (&worker, &ctx->table, request->max_bits, FALSE);
+			capacity = request->max_bits;
+		}
+		search (request, &worker, 0);
+		sem_post (&ctx->done);
+	}
+	if (capacity)
+		worker_clear (&worker);
+	return NULL;
+}
+
+/* This function passes a prime found by a worker to the callback of the current request. */
+static void
+deliver_prime (const mpz_t prime, long index, void *ctx_arg)
+{
+	mrprimes_ctx *ctx = (mrprimes_ctx *)ctx_arg;
+	pthread_mutex_lock (&ctx->callback_lock);
+	ctx->callback (prime, index, ctx->arg);
+	pthread_mutex_unlock (&ctx->callback_lock);
+}
+
+mrprimes_ctx *
+mrprimes_create (long num_offsets, long num_threads, int rounds, uint64_t seed)
+{
+	if (num_offsets < 0 || num_threads < 0 || rounds < 0 || rounds >= 200)
+		return NULL;
+	if (!num_threads && (num_threads = sysconf (_SC_NPROCESSORS_ONLN)) <= 0)
+		num_threads = 1;
+	mrprimes_ctx *ctx = malloc (sizeof (mrprimes_ctx));
+	pthread_t *threads = malloc (num_threads * sizeof (pthread_t));
+	if (!ctx || !threads)
+	{
+		fprintf (stderr, "Error: unable to allocate memory for the generator context.\n");
+		exit (EXIT_FAILURE);
+	}
+	table_init (&ctx->table, NULL, num_offsets ? num_offsets : DEFAULT_OFFSETS, 0, SIEVE_WINDOW);
+	ctx->rounds = rounds ? rounds : DEFAULT_ROUNDS;
+	ctx->seed = seed;
+	ctx->next_stream = 0;
+	atomic_init (&ctx->next_test, 0);
+	ctx->num_threads = num_threads;
+	ctx->threads = threads;
+	pthread_mutex_init (&ctx->request_lock, NULL);
+	pthread_mutex_init (&ctx->callback_lock, NULL);
+	sem_init (&ctx->start, 0, 0);
+	sem_init (&ctx->done, 0, 0);
+	ctx->request = NULL;
+	atomic_init (&ctx->stop, STOP_NONE);
+	pthread_mutex_init (&ctx->test_lock, NULL);
+	scratch_init (&ctx->test_scratch, DEFAULT_TEST_BITS);
+	ctx->test_scratch.stop = &ctx->stop;
+	gmp_randinit_mt (ctx->test_random);
+	ctx->test_bits = DEFAULT_TEST_BITS;
+	for (long i = 0; i < num_threads; ++i)
+	{
+		int return_code = pthread_create (&threads[i], NULL, serve_requests, (void *)ctx);
+		if (return_code)
+		{
+			fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+			exit (EXIT_FAILURE);
+		}
+	}
+	return ctx;
+}
+
+int
+mrprimes_generate (mrprimes_ctx *ctx, long bits, long count, mrprimes_callback callback, void *arg)
+{
+	if (!ctx || bits < 32 || count < 0 || !callback)
+		return -1;
+	if (!count)
+		return 0;
+	
+	pthread_mutex_lock (&ctx->request_lock);
+	struct thread_data_t request = {10, ctx->rounds, &ctx->table, count}; // the number of digits is not used since the number of bits is set
+	thread_args_init (&request, TRUE, 1, bits, ctx->seed);
+	request.quiet = TRUE;
+	request.found = deliver_prime;
+	request.found_arg = ctx;
+	request.stop = &ctx->stop;
+	request.first_stream = ctx->next_stream;
+	ctx->next_stream += count;
+	ctx->callback = callback;
+	ctx->arg = arg;
+	ctx->request = &request;
+	
+	/* Every worker takes part in every request, and the workers with no starting point left to claim are done at once. */
+	for (long i = 0; i < ctx->num_threads; ++i)
+		sem_post (&ctx->start);
+	for (long i = 0; i < ctx->num_threads; ++i)
+		while (sem_wait (&ctx->done))
+			continue;
+	
+	ctx->request = NULL;
+	mpz_clears (request.start_low, request.start_range, NULL);
+	pthread_mutex_unlock (&ctx->request_lock);
+	return 0;
+}
+
+/* This function tests n, which has survived trial division, with the random stream numbered stream. */
+static int
+test_stream (mrprimes_ctx *ctx, const mpz_t n, uint64_t stream, gmp_randstate_t random, struct scratch_t *scratch)
+{
+	seed_stream (random, ctx->seed, stream, scratch->stream_seed);
+	return miller_rabin (n, ctx->rounds, TRUE, random, scratch) == VERDICT_PROBABLE_PRIME;
+}
+
+int
+mrprimes_is_probable_prime (mrprimes_ctx *ctx, const mpz_t n)
+{
+	const enum trial_result trial = trial_division (&ctx->table, n);
+	if (trial != TRIAL_UNDECIDED)
+		return trial == TRIAL_PRIME;
+	
+	/* Each test gets its own random stream, counting down from the last stream, so that its verdict does not depend on the
+	thread which calls it. The test uses the scratch of the context, which grows with the candidates, unless another thread
+	is using it, in which case this one allocates its own rather than waiting. */
+	const uint64_t stream = UINT64_MAX - atomic_fetch_add (&ctx->next_test, 1);
+	const mp_bitcnt_t bits = mpz_sizeinbase (n, 2) + 1;
+	if (!pthread_mutex_trylock (&ctx->test_lock))
+	{
+		if (bits > ctx->test_bits)
+		{
+			scratch_clear (&ctx->test_scratch);
+			scratch_init (&ctx->test_scratch, bits);
+			ctx->test_scratch.stop = &ctx->stop;
+			ctx->test_bits = bits;
+		}
+		const int probably_prime = test_stream (ctx, n, stream, ctx->test_random, &ctx->test_scratch);
+		pthread_mutex_unlock (&ctx->test_lock);
+		return probably_prime;
+	}
+	gmp_randstate_t random;
+	gmp_randinit_mt (random);
+	struct scratch_t scratch;
+	scratch_init (&scratch, bits);
+	scratch.stop = &ctx->stop;
+	const int probably_prime = test_stream (ctx, n, stream, random, &scratch);
+	scratch_clear (&scratch);
+	gmp_randclear (random);
+	return probably_prime;
+}
+
+void
+mrprimes_destroy (mrprimes_ctx *ctx)
+{
+	if (!ctx)
+		return;
+	ctx->request = NULL;
+	for (long i = 0; i < ctx->num_threads; ++i)
+		sem_post (&ctx->start);
+	for (long i = 0; i < ctx->num_threads; ++i)
+		pthread_join (ctx->threads[i], NULL);
+	sem_destroy (&ctx->start);
+	sem_destroy (&ctx->done);
+	pthread_mutex_destroy (&ctx->request_lock);
+	pthread_mutex_destroy (&ctx->callback_lock);
+	pthread_mutex_destroy (&ctx->test_lock);
+	scratch_clear (&ctx->test_scratch);
+	gmp_randclear (ctx->test_random);
+	table_free (&ctx->table);
+	free (ctx->threads);
+	free (ctx);
+}
@@ -17,60 +17,372 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+	#define _GNU_SOURCE // for pinning the workers to processors (see placement_init)
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
 #include "gmp.h"
 #include "timer.h"
 
 /* Create boolean type. */
 enum boolean {FALSE, TRUE};
 /* Set constants. */
-enum constants {BASE = 10, THREAD_STACKSIZE = 1024};
-static uint32_t *offset_primes = NULL; // to be initialized in main before threads are created
+enum constants {BASE = 10, SIEVE_WINDOW = 65536, CACHE_LINE_SIZE = 64}; // SIEVE_WINDOW is the default number of odd integers sieved at once
+/* Limits of the number of odd integers sieved at once (-W), which must also be a multiple of 64. */
+enum window_limits {MIN_SIEVE_WINDOW = 1024, MAX_SIEVE_WINDOW = 1 << 24};
+/* Formats in which the primes can be written to the output file. */
+enum output_format {FORMAT_DECIMAL, FORMAT_HEX, FORMAT_BINARY};
+/* Engines which can be used to test the candidates (--test). */
+enum primality_test {TEST_MILLER_RABIN, TEST_BPSW};
+/* The output file is written through a buffer of WRITER_BUFFER_SIZE bytes, and at most WRITER_QUEUE_SIZE results wait
+in the writer's queue before the workers block on it, so that a slow reader of the output holds back the search. */
+enum writer_constants {WRITER_BUFFER_SIZE = 1 << 20, WRITER_QUEUE_SIZE = 4096};
+/* Above this many limbs, GMP's subquadratic division reduces a square faster than the basecase Montgomery reduction. */
+enum montgomery_limits {MONTGOMERY_MAX_LIMBS = 96};
+/* Offset primes must fit in a signed 32 bit integer, and the odd integers in each segment of the sieve over them are packed 64 to a word. */
+enum offset_prime_limits {MAX_OFFSET_PRIME = 2147483647, BASE_PRIMES_LIMIT = 46341, SEGMENT_SIZE = 262144};
+/* The offset primes can be kept in a table file (-T), which starts with this header and is followed by the primes as 32 bit integers
+in the byte order of the machine that wrote it. A table file written on a machine with the other byte order fails the magic check. */
+struct table_header_t
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t num_primes;
+};
+enum table_constants {TABLE_MAGIC = 0x5450524D, TABLE_VERSION = 1};
+
+/* The following structure contains the offset primes and the tables derived from them, which are built before the workers
+are started and only read by them. The offsets of each offset prime are stored in the narrowest type which holds the prime:
+8 bits for the primes below 2^8, 16 bits for the primes below 2^16, and 32 bits for the rest. Since the primes are sorted, each
+width covers one block of them, and the primes and wraps of each block are stored in arrays of the same width, so that a vector
+instruction handles four times as many of the smallest offsets as of the largest ones. For each offset prime p, the wrap is
+p - (window mod p), which is used to advance its offset by one window with a comparison instead of a division (see advance_offsets). */
+struct offset_table_t
+{
+	long num_offsets; // number of offset primes
+	long window; // number of odd integers sieved at once
+	uint32_t *primes;
+	void *map; // the table file mapped into memory, if primes points into it
+	size_t map_size;
+	/* Products of consecutive offset primes which fit in an unsigned long, along with the number of primes in each. */
+	unsigned long *groups;
+	unsigned char *group_sizes;
+	long num_groups;
+	long num_offsets8; // number of offset primes below 2^8
+	long num_offsets16; // number of offset primes below 2^16, including those below 2^8
+	uint8_t *primes8;
+	uint8_t *wraps8;
+	uint16_t *primes16;
+	uint16_t *wraps16;
+	uint32_t *wraps32;
+};
 
 #define VERSION_NUMBER_STRING "1.0.7"
 
-/* The following structure contains the necessary arguments to allow the threads to perform their function. */
+/* Stages of the search for a prime which are timed, and events which are counted, by the worker timers. */
+enum stage {STAGE_GEN_START, STAGE_OFFSET_INIT, STAGE_NEXT_TEST, STAGE_MILLER_RABIN, NUM_STAGES};
+static const char *stage_names[NUM_STAGES] = {"gen_start", "offset_init", "next_test", "miller_rabin"};
+enum counter {COUNT_SIEVED, COUNT_TESTS, COUNT_REJECTED, COUNT_PRIMES, NUM_COUNTERS}; // COUNT_SIEVED is odd integers passed over by the sieve
+
+/* Reasons for the workers to stop searching before all of the primes have been found, and how they are reported. */
+enum stop_reason {STOP_NONE, STOP_SIGNAL, STOP_CLOSED, STOP_TIMEOUT, STOP_BUDGET, NUM_STOP_REASONS};
+static const char *stop_reasons[NUM_STOP_REASONS] = {"", "a signal", "the reader of the output going away", "the timeout", "the candidate budget"};
+/* A program which stops early exits with this status, after writing the primes it found. */
+enum exit_status {EXIT_INCOMPLETE = 2};
+
+/* Set to the reason for stopping, when SIGINT or SIGTERM arrives, the reader of the output goes away, the timeout expires
+or the candidate budget is used up, to make the workers stop searching. It is polled by the workers between candidates,
+and between the rounds of the Miller-Rabin test. This is the flag of the program's searches, and each context of the
+library has its own (see thread_data_t). */
+static atomic_int stop_requested;
+
+/* Status lines go to standard output, unless the primes themselves are written there. */
+static FILE *status_out;
+
+/* This function makes the workers polling a stop flag stop searching, unless they have already been stopped for another reason. */
+static void
+stop_search (atomic_int *stop, int reason)
+{
+	int none = STOP_NONE;
+	atomic_compare_exchange_strong (stop, &none, reason);
+}
+
+/* This function is the handler for SIGINT, SIGTERM and the SIGALRM of the timeout. */
+static void
+request_stop (int signal_number)
+{
+	stop_search (&stop_requested, signal_number == SIGALRM ? STOP_TIMEOUT : STOP_SIGNAL);
+}
+
+/* The following structure contains the necessary arguments to allow the threads to perform their function.
+The counters which the workers update while searching each have a cache line of their own, so that updating
+them does not take the cache lines of the read-only arguments away from the other workers. */
 struct thread_data_t
 {
 	const long num_digits;
 	const long precision;
-	const long num_offsets;
-	long current_num_primes;
-	char *out_file_name_pointer;
-	/* Two randstates are necessary when multithreading to ensure the same primes are found when the same seed is used. */
-	gmp_randstate_t random1; // for generating starting points
-	gmp_randstate_t random2; // for generating random numbers for the test itself
-	pthread_mutex_t current_num_primes_mutex;
-	pthread_mutex_t out_file_mutex;
-	pthread_mutex_t rand_state_mutex1;
-	pthread_mutex_t rand_state_mutex2;
+	const struct offset_table_t *const table;
+	const long num_primes;
+	enum boolean prefilter; // whether to perform a base 2 round before the randomized rounds
+	enum primality_test test; // engine used to test the candidates
+	struct cooperation_t *cooperation; // state shared by the workers when they cooperate on each starting point, or NULL
+	struct checkpoint_t *checkpoint; // state of the search saved by the checkpointer, or NULL
+	struct placement_t *placement; // placement of the workers on the processors, or NULL to let them run anywhere
+	long per_start; // number of consecutive primes to find from each starting point
+	struct writer_t *writer;
+	enum output_format format;
+	/* Without a writer, each prime is passed to this function along with its index and found_arg, if it is not NULL. It is called from the worker threads. */
+	void (*found) (const mpz_t prime, long index, void *found_arg);
+	void *found_arg;
+	/* Each starting point gets its own random stream derived from the seed (see seed_stream), which ensures that
+	the same primes are found when the same seed is used regardless of how the workers are scheduled. */
+	uint64_t seed;
+	uint64_t first_stream; // index of the random stream of the first starting point
+	long num_bits; // number of bits of primes to generate, overriding num_digits if not 0
+	mpz_t start_low, start_range; // bounds of the starting points (see init_start_bounds)
+	mp_bitcnt_t max_bits; // upper bound on the size of the candidates
+	enum boolean quiet; // whether to skip printing a line for every prime found
+	FILE *status_out; // stream of the line printed for every prime found, status_out for the program's searches
+	enum boolean safe; // whether to search for safe primes p = 2q + 1 with q prime instead
+	struct timer_set_t *timers; // timers of the workers when benchmarking or reporting progress, or NULL
+	long max_candidates; // number of candidates which may be tested before the search is stopped, or 0 for no limit
+	atomic_int *stop; // flag polled by the workers, &stop_requested for the program's searches (see stop_search)
+	_Alignas (CACHE_LINE_SIZE) atomic_long next_start_index; // index of the next starting point to be claimed by a worker
+	_Alignas (CACHE_LINE_SIZE) atomic_long current_num_primes;
+	_Alignas (CACHE_LINE_SIZE) atomic_long num_candidates; // number of candidates tested so far, only counted if there is a limit
 };
 
+/* The following structure contains the state of the search for a prime from one starting point: the offsets of
+the start of the current window of odd integers, and a bitmap of the odd integers in that window known to be composite. */
+struct sieve_t
+{
+	const struct offset_table_t *table;
+	mpz_t window_start;
+	void *memory; // one allocation holding the offsets and the bitmap
+	uint8_t *offsets8; // offsets for the offset primes below 2^8
+	uint16_t *offsets16; // offsets for the rest of the offset primes below 2^16
+	uint32_t *offsets32; // offsets for the rest of the offset primes
+	/* When searching for safe primes, the sieve runs over q, and these offsets, of the same widths, are those of 2q + 1
+	(see offset_init). Otherwise they are NULL. */
+	uint8_t *safe_offsets8;
+	uint16_t *safe_offsets16;
+	uint32_t *safe_offsets32;
+	uint64_t *bits;
+	long position; // index of the next bit in the window to be examined, or -1 if the window has not been sieved yet
+	long sieved; // number of odd integers passed over since the sieve was allocated
+};
 
-/* This function generates low odd primes for offsets at start of program run. */
+/* This function generates low odd primes for offsets at start of program run, either a given number of them or all
+of those up to a given limit (when sieve_limit is not 0), and stores them in the table. The primes
+are found with a segmented Sieve of Eratosthenes over odd integers only, where bit i of a segment stands for the odd
+integer 2 * (low + i) + 1, and the odd primes up to the square root of MAX_OFFSET_PRIME are used to sieve each segment. */
 static void
-init_offsets (const long num_offsets)
+init_offsets (struct offset_table_t *table, const long num_offsets, const long sieve_limit)
 {
-	uint32_t np = 0, n = 3; // number of primes, first odd prime
-	while (np < num_offsets)
+	/* Find the base primes by sieving the odd integers below the square root of MAX_OFFSET_PRIME. */
+	char composite[BASE_PRIMES_LIMIT / 2] = {0};
+	uint32_t base_primes[BASE_PRIMES_LIMIT / 2];
+	long num_base_primes = 0;
+	for (uint32_t n = 3; n < BASE_PRIMES_LIMIT; n += 2)
+	{
+		if (composite[n / 2])
+			continue;
+		base_primes[num_base_primes++] = n;
+		for (uint32_t m = n * n; m < BASE_PRIMES_LIMIT; m += 2 * n)
+			composite[m / 2] = 1;
+	}
+	
+	long capacity = sieve_limit ? 1024 : num_offsets;
+	long np = 0; // number of primes
+	uint32_t *offset_primes = malloc (capacity * sizeof (uint32_t));
+	uint64_t *segment = malloc (SEGMENT_SIZE / 64 * sizeof (uint64_t));
+	if (!offset_primes || !segment)
 	{
-		enum boolean prime = TRUE;
-		for (int i = 0; i < np; ++i)
+		fprintf (stderr, "Error: failure to allocate offset primes.\n");
+		exit (EXIT_FAILURE);
+	}
+	
+	/* Sieve one segment of odd integers at a time, beginning with the first odd prime. */
+	for (uint64_t low = 1; sieve_limit ? 2 * low + 1 <= (uint64_t)sieve_limit : np < num_offsets; low += SEGMENT_SIZE)
+	{
+		if (2 * low + 1 > MAX_OFFSET_PRIME)
 		{
-			if (n % offset_primes[i] == 0)
-			{
-				prime = FALSE;
+			fprintf (stderr, "Error: offset primes must be less than %ld.\n", (long)MAX_OFFSET_PRIME);
+			exit (EXIT_FAILURE);
+		}
+		
+		memset (segment, 0, SEGMENT_SIZE / 64 * sizeof (uint64_t));
+		const uint64_t high = low + SEGMENT_SIZE; // bit indices low through high - 1
+		for (long i = 0; i < num_base_primes; ++i)
+		{
+			/* Start marking at the square of the base prime or the first odd multiple in the segment, whichever is greater. */
+			const uint64_t q = base_primes[i];
+			if (q * q / 2 >= high)
 				break;
+			uint64_t j = q * q / 2;
+			if (j < low)
+				j += (low - j + q - 1) / q * q;
+			for (j -= low; j < SEGMENT_SIZE; j += q)
+				segment[j / 64] |= (uint64_t)1 << (j % 64);
+		}
+		
+		/* Collect the unmarked odd integers in the segment. */
+		for (uint64_t j = 0; j < SEGMENT_SIZE; ++j)
+		{
+			if (segment[j / 64] & ((uint64_t)1 << (j % 64)))
+				continue;
+			const uint64_t n = 2 * (low + j) + 1;
+			if (sieve_limit ? n > (uint64_t)sieve_limit : np == num_offsets)
+				break;
+			if (np == capacity)
+			{
+				capacity *= 2;
+				offset_primes = realloc (offset_primes, capacity * sizeof (uint32_t));
+				if (!offset_primes)
+				{
+					fprintf (stderr, "Error: failure to allocate offset primes.\n");
+					exit (EXIT_FAILURE);
+				}
+			}
+			offset_primes[np++] = (uint32_t)n;
+		}
+	}
+	
+	free (segment);
+	table->primes = offset_primes;
+	table->num_offsets = np;
+	table->map = NULL;
+}
+
+/* This function maps the offset primes table file into memory, and if it holds enough primes, either a given number of them
+or all of those up to a given limit (when sieve_limit is not 0), points the offset primes of the table at them and returns TRUE.
+Otherwise, including when the file does not exist or is not a valid table, it returns FALSE. The mapping is read only and
+shared, so every process using the same table file shares one copy of it in the page cache. */
+static enum boolean
+map_offset_table (struct offset_table_t *table, const char *table_name, const long num_offsets, const long sieve_limit)
+{
+	const int fd = open (table_name, O_RDONLY);
+	if (fd < 0)
+		return FALSE;
+	struct stat status;
+	if (fstat (fd, &status) || status.st_size < (off_t)sizeof (struct table_header_t))
+	{
+		close (fd);
+		return FALSE;
+	}
+	void *map = mmap (NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED)
+		return FALSE;
+	
+	const struct table_header_t *header = (const struct table_header_t *)map;
+	uint32_t *primes = (uint32_t *)((char *)map + sizeof (struct table_header_t));
+	long count = 0;
+	if (header->magic == TABLE_MAGIC && header->version == TABLE_VERSION && header->num_primes > 0
+		&& (uint64_t)status.st_size == sizeof (struct table_header_t) + header->num_primes * sizeof (uint32_t))
+	{
+		const long num_primes = (long)header->num_primes;
+		if (!sieve_limit)
+			count = num_offsets <= num_primes ? num_offsets : 0;
+		else if (primes[num_primes - 1] >= (uint32_t)sieve_limit)
+		{
+			/* Binary search for the number of primes up to the limit. */
+			long low = 0, high = num_primes;
+			while (low < high)
+			{
+				const long middle = low + (high - low) / 2;
+				if (primes[middle] <= (uint32_t)sieve_limit)
+					low = middle + 1;
+				else
+					high = middle;
 			}
+			count = low;
 		}
-		if (prime)
-			offset_primes[np++] = n;
-		n += 2; // next odd integer
 	}
+	if (!count)
+	{
+		munmap (map, status.st_size);
+		return FALSE;
+	}
+	table->map = map;
+	table->map_size = status.st_size;
+	table->primes = primes;
+	table->num_offsets = count;
+	return TRUE;
+}
+
+/* This function writes the offset primes of a table to a table file. The table is written to a temporary file which is then renamed,
+so that other processes reading the table file never see it partly written. Failing to write it is not an error. */
+static void
+write_offset_table (const struct offset_table_t *table, const char *table_name)
+{
+	char temp_name[4096];
+	snprintf (temp_name, sizeof (temp_name), "%s.%ld.tmp", table_name, (long)getpid ());
+	FILE *table_file = fopen (temp_name, "wb");
+	if (!table_file)
+	{
+		fprintf (stderr, "Warning: unable to write offset table %s.\n", table_name);
+		return;
+	}
+	const struct table_header_t header = {TABLE_MAGIC, TABLE_VERSION, (uint64_t)table->num_offsets};
+	const enum boolean written = fwrite (&header, sizeof (header), 1, table_file) == 1
+		&& fwrite (table->primes, sizeof (uint32_t), table->num_offsets, table_file) == (size_t)table->num_offsets;
+	if (fclose (table_file) || !written || rename (temp_name, table_name))
+	{
+		fprintf (stderr, "Warning: unable to write offset table %s.\n", table_name);
+		remove (temp_name);
+	}
+}
+
+/* This function loads the offset primes of a table from the table file if one was given and it holds enough of them, and
+otherwise generates them with init_offsets, replacing the table file with the new primes. */
+static void
+load_offsets (struct offset_table_t *table, const char *table_name, const long num_offsets, const long sieve_limit)
+{
+	if (table_name && map_offset_table (table, table_name, num_offsets, sieve_limit))
+		return;
+	init_offsets (table, num_offsets, sieve_limit);
+	if (table_name)
+		write_offset_table (table, table_name);
+}
+
+/* This function frees the offset primes of a table, whether they were generated or mapped from the table file. */
+static void
+free_offsets (struct offset_table_t *table)
+{
+	if (table->map)
+		munmap (table->map, table->map_size);
+	else
+		free (table->primes);
+	table->primes = NULL;
+	table->map = NULL;
 }
 
 /* This function takes the remainder of a product and assigns the result to the first parameter (mpz_t acts as a reference). */
@@ -81,249 +393,4359 @@ mul_mod (mpz_t result, const mpz_t factor0, const mpz_t factor1, const mpz_t mod
 	mpz_mod (result, result, mod);
 }
 
-/* This function uses the Miller-Rabin method to test the primality of an odd integer n with precision variable k. */
+/* The following structure contains the constants needed to square modulo an odd integer n in Montgomery form, where
+x is represented by xR mod n with R = 2^(GMP_NUMB_BITS * size). It is built lazily, the first time a squaring modulo n is
+needed, and then reused by every round of the Miller-Rabin test performed on n. The memory for the constants is allocated
+once per worker for the largest possible n, so building them for each new n does not allocate. */
+struct montgomery_t
+{
+	enum boolean ready; // whether the constants have been built for the current n
+	mp_limb_t *buffer; // 7 * max_size + 3 limbs used for the constants and the scratch space
+	mp_size_t max_size;
+	mp_size_t size; // number of limbs of n
+	const mp_limb_t *n;
+	mp_limb_t n_inverse; // -n^-1 mod 2^GMP_NUMB_BITS
+	mp_limb_t *r_squared; // R^2 mod n
+	mp_limb_t *one; // 1 in Montgomery form, i.e. R mod n
+	mp_limb_t *minus_one; // n - 1 in Montgomery form
+	mp_limb_t *x;
+	mp_limb_t *product; // 2 * size + 1 limbs of scratch space
+	mp_limb_t *quotient; // size + 2 limbs of scratch space
+};
+
+/* This function performs the Montgomery reduction of the 2 * size limb product, i.e. result = product / R mod n.
+Row i adds a multiple of n which clears limb i of the product, and the carry out of the row is saved in the limb it
+cleared, since no later row depends on it. The saved carries are then added to the upper half of the product. */
+static void
+montgomery_reduce (const struct montgomery_t *mont, mp_limb_t *result, mp_limb_t *product)
+{
+	for (mp_size_t i = 0; i < mont->size; ++i)
+		product[i] = mpn_addmul_1 (product + i, mont->n, mont->size, product[i] * mont->n_inverse);
+	if (mpn_add_n (result, product + mont->size, product, mont->size) || mpn_cmp (result, mont->n, mont->size) >= 0)
+		mpn_sub_n (result, result, mont->n, mont->size);
+}
+
+/* This function allocates the memory for the Montgomery constants of any n with at most max_size limbs. */
+static void
+montgomery_alloc (struct montgomery_t *mont, mp_size_t max_size)
+{
+	mont->ready = FALSE;
+	mont->max_size = max_size;
+	mont->buffer = malloc ((7 * max_size + 3) * sizeof (mp_limb_t));
+	if (!mont->buffer)
+	{
+		fprintf (stderr, "Error: failure to allocate Montgomery constants.\n");
+		exit (EXIT_FAILURE);
+	}
+}
+
+/* This function computes the constants for squaring modulo n in Montgomery form. */
+static void
+montgomery_init (struct montgomery_t *mont, const mpz_t n)
+{
+	mont->size = mpz_size (n);
+	mont->n = mpz_limbs_read (n);
+	mont->r_squared = mont->buffer;
+	mont->one = mont->r_squared + mont->size;
+	mont->minus_one = mont->one + mont->size;
+	mont->x = mont->minus_one + mont->size;
+	mont->product = mont->x + mont->size;
+	mont->quotient = mont->product + 2 * mont->size + 1;
+	
+	/* Since n is odd, n * n = 1 mod 8, and each Newton iteration doubles the number of correct low bits of the inverse. */
+	mp_limb_t inverse = mont->n[0];
+	for (int i = 0; i < 6; ++i)
+		inverse *= 2 - mont->n[0] * inverse;
+	mont->n_inverse = -inverse;
+	
+	/* R^2 mod n is the only constant which requires a division. */
+	memset (mont->product, 0, 2 * mont->size * sizeof (mp_limb_t));
+	mont->product[2 * mont->size] = 1;
+	mpn_tdiv_qr (mont->quotient, mont->r_squared, 0, mont->product, 2 * mont->size + 1, mont->n, mont->size);
+	
+	/* R mod n is the reduction of R^2 mod n. */
+	memcpy (mont->product, mont->r_squared, mont->size * sizeof (mp_limb_t));
+	memset (mont->product + mont->size, 0, mont->size * sizeof (mp_limb_t));
+	montgomery_reduce (mont, mont->one, mont->product);
+	mpn_sub_n (mont->minus_one, mont->n, mont->one, mont->size);
+	mont->ready = TRUE;
+}
+
+/* This function frees the memory held by the Montgomery constants. */
+static void
+montgomery_free (struct montgomery_t *mont)
+{
+	free (mont->buffer);
+	mont->buffer = NULL;
+	mont->ready = FALSE;
+}
+
+/* Candidates below 2^64 are tested by a fixed-width backend instead of GMP when the compiler has 128 bit integers (unless
+MRPRIMES_GENERIC is defined): a Miller-Rabin test in machine words with the seven bases found by Jim Sinclair, which is
+deterministic below 2^64, so that such a candidate takes no random rounds and no mpz arithmetic at all. Larger candidates
+are left to GMP, whose assembly beats an unrolled fixed-width kernel already from two limbs on. */
+#if defined(__SIZEOF_INT128__) && ULONG_MAX == UINT64_MAX && !defined(MRPRIMES_GENERIC)
+	#define FIXED_WIDTH 1
+#else
+	#define FIXED_WIDTH 0
+#endif
+
+#if FIXED_WIDTH
+static const uint64_t deterministic_bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+/* This function returns -n^-1 mod 2^64 for an odd n. Since n * n = 1 mod 8, and each Newton iteration doubles the number
+of correct low bits of the inverse, six iterations are enough. */
+static uint64_t
+negated_inverse (uint64_t n)
+{
+	uint64_t inverse = n;
+	for (int i = 0; i < 6; ++i)
+		inverse *= 2 - n * inverse;
+	return -inverse;
+}
+
+/* This function returns x * y / 2^64 mod n for x, y < n < 2^64. Since x * y + m * n is divisible by 2^64, its low half
+only carries into the high half when x * y has a low half which is not 0. */
+static inline uint64_t
+u64_montgomery_mul (uint64_t x, uint64_t y, uint64_t n, uint64_t n_inverse)
+{
+	const unsigned __int128 product = (unsigned __int128)x * y;
+	const uint64_t m = (uint64_t)product * n_inverse;
+	const unsigned __int128 sum = (product >> 64) + (((unsigned __int128)m * n) >> 64) + ((uint64_t)product != 0);
+	return (uint64_t)(sum >= n ? sum - n : sum);
+}
+
+/* This function returns whether an odd n < 2^64 above 3 is prime, by the Miller-Rabin test with every one of the
+deterministic bases, in Montgomery form with R = 2^64. */
+static enum boolean
+u64_is_prime (uint64_t n)
+{
+	const uint64_t n_inverse = negated_inverse (n);
+	const uint64_t one = -n % n; // 2^64 mod n
+	const uint64_t minus_one = n - one;
+	const uint64_t r_squared = (uint64_t)(((unsigned __int128)one << 64) % n);
+	const int s = __builtin_ctzll (n - 1);
+	const uint64_t d = (n - 1) >> s;
+	
+	for (size_t i = 0; i < sizeof (deterministic_bases) / sizeof (deterministic_bases[0]); ++i)
+	{
+		if (deterministic_bases[i] % n == 0)
+			continue;
+		
+		/* x = a^d % n, by binary exponentiation from the highest bit of d. */
+		const uint64_t a = u64_montgomery_mul (deterministic_bases[i] % n, r_squared, n, n_inverse);
+		uint64_t x = a;
+		for (int bit = 62 - __builtin_clzll (d); bit >= 0; --bit)
+		{
+			x = u64_montgomery_mul (x, x, n, n_inverse);
+			if (d >> bit & 1)
+				x = u64_montgomery_mul (x, a, n, n_inverse);
+		}
+		if (x == one || x == minus_one)
+			continue;
+		int r;
+		for (r = 1; r < s; ++r)
+		{
+			x = u64_montgomery_mul (x, x, n, n_inverse);
+			if (x == minus_one)
+				break;
+			if (x == one)
+				return FALSE;
+		}
+		if (r == s)
+			return FALSE;
+	}
+	return TRUE;
+}
+#endif
+
+/* This function seeds the random state of a worker with the stream for one starting point index. The stream
+seed is (seed * 2^64 + index), so every starting point gets an independent stream determined by the seed. */
+static void
+seed_stream (gmp_randstate_t random, uint64_t seed, uint64_t index, mpz_t stream_seed)
+{
+	mpz_set_ui (stream_seed, seed);
+	mpz_mul_2exp (stream_seed, stream_seed, 64);
+	mpz_add_ui (stream_seed, stream_seed, index);
+	gmp_randseed (random, stream_seed);
+}
+
+/* This function seeds the random state of a worker with the stream for one chunk of the cooperative search from a
+starting point (see cooperate). The stream seed is 2^192 + (seed * 2^64 + index) * 2^64 + chunk, which is above every
+stream seed of a starting point, so that the streams of the chunks never coincide with those. */
+static void
+seed_chunk_stream (gmp_randstate_t random, uint64_t seed, uint64_t index, uint64_t chunk, mpz_t stream_seed)
+{
+	mpz_set_ui (stream_seed, 1);
+	mpz_mul_2exp (stream_seed, stream_seed, 64);
+	mpz_add_ui (stream_seed, stream_seed, seed);
+	mpz_mul_2exp (stream_seed, stream_seed, 64);
+	mpz_add_ui (stream_seed, stream_seed, index);
+	mpz_mul_2exp (stream_seed, stream_seed, 64);
+	mpz_add_ui (stream_seed, stream_seed, chunk);
+	gmp_randseed (random, stream_seed);
+}
+
+/* The following structure contains the temporaries used by a worker to test candidates, which are kept
+alive between candidates and primes so that the search does not allocate any memory once it has started. */
+struct scratch_t
+{
+	mpz_t d, a, x, n_minus_1;
+	mpz_t u, v, q_power; // terms of the Lucas sequences (see strong_lucas)
+	mpz_t stream_seed;
+	struct montgomery_t mont;
+	atomic_int *stop; // flag which stops a test part way, &stop_requested unless the worker searches with another (see search)
+	/* When the stream of a chunk is only seeded once the Miller-Rabin test draws from it (see cooperate), the seed, index and
+	chunk of the stream, and whether it has yet to be seeded. */
+	enum boolean stream_pending;
+	uint64_t pending_seed, pending_index, pending_chunk;
+};
+
+/* This function allocates the temporaries of a worker for candidates of at most max_bits bits. */
+static void
+scratch_init (struct scratch_t *scratch, mp_bitcnt_t max_bits)
+{
+	mpz_init2 (scratch->d, max_bits);
+	mpz_init2 (scratch->a, max_bits);
+	mpz_init2 (scratch->x, 2 * max_bits);
+	mpz_init2 (scratch->n_minus_1, max_bits);
+	mpz_init2 (scratch->u, max_bits);
+	mpz_init2 (scratch->v, max_bits);
+	mpz_init2 (scratch->q_power, max_bits);
+	mpz_init2 (scratch->stream_seed, 128);
+	montgomery_alloc (&scratch->mont, (max_bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS);
+	scratch->stop = &stop_requested;
+	scratch->stream_pending = FALSE;
+}
+
+/* This function frees the temporaries of a worker. */
+static void
+scratch_clear (struct scratch_t *scratch)
+{
+	mpz_clears (scratch->d, scratch->a, scratch->x, scratch->n_minus_1, scratch->u, scratch->v, scratch->q_power, scratch->stream_seed, NULL);
+	montgomery_free (&scratch->mont);
+}
+
+/* This function performs one round of the Miller-Rabin test on n with base a, where n - 1 = 2^s*d with d odd,
+and returns whether n is a strong probable prime to base a. The value of x is overwritten. If mont is not NULL
+and n is small enough for Montgomery reduction to beat GMP's division, the squarings are done in Montgomery form. */
 static enum boolean
-miller_rabin (const mpz_t n, int k, gmp_randstate_t random, pthread_mutex_t *rand_state_mutex)
+strong_probable_prime (const mpz_t n, const mpz_t a, const mpz_t d, uint64_t s, const mpz_t n_minus_1, mpz_t x, struct montgomery_t *mont)
+{
+	/* x = a^d % n */
+	mpz_powm (x, a, d, n);
+	
+	if (!mpz_cmp_ui (x, 1) || !mpz_cmp (x, n_minus_1)) // if (x == 1 || x == n - 1)
+		return TRUE;
+	
+	if (mont && s > 1 && mpz_size (n) <= MONTGOMERY_MAX_LIMBS && (mp_size_t)mpz_size (n) <= mont->max_size && !GMP_NAIL_BITS)
+	{
+		if (!mont->ready)
+			montgomery_init (mont, n);
+		
+		/* Convert x to Montgomery form by multiplying it by R^2 mod n and reducing. */
+		memset (mont->x, 0, mont->size * sizeof (mp_limb_t));
+		memcpy (mont->x, mpz_limbs_read (x), mpz_size (x) * sizeof (mp_limb_t));
+		mpn_mul_n (mont->product, mont->x, mont->r_squared, mont->size);
+		montgomery_reduce (mont, mont->x, mont->product);
+		
+		for (uint64_t r = 1; r < s; ++r)
+		{
+			mpn_sqr (mont->product, mont->x, mont->size);
+			montgomery_reduce (mont, mont->x, mont->product); // x = x * x % n
+			if (!mpn_cmp (mont->x, mont->one, mont->size)) // if (x == 1)
+				return FALSE;
+			if (!mpn_cmp (mont->x, mont->minus_one, mont->size)) // if (x == n - 1)
+				return TRUE;
+		}
+		return FALSE; // the for loop completed
+	}
+	
+	for (uint64_t r = 1; r < s; ++r)
+	{
+		mul_mod (x, x, x, n); // x = x * x % n
+		if (!mpz_cmp_ui (x, 1)) // if (x == 1)
+			return FALSE;
+		if (!mpz_cmp (x, n_minus_1)) // if (x == n - 1)
+			return TRUE;
+	}
+	return FALSE; // the for loop completed
+}
+
+/* Outcomes of a primality test. A test which is stopped before it has finished has no verdict on the candidate. */
+enum verdict {VERDICT_COMPOSITE, VERDICT_PROBABLE_PRIME, VERDICT_STOPPED};
+
+/* This function uses the Miller-Rabin method to test the primality of an odd integer n with precision variable k.
+If prefilter is set, a round with the fixed base 2 is performed first, which rejects nearly every composite
+without drawing from the random state, so that the k randomized rounds are almost only performed on primes.
+The randomized rounds share one set of Montgomery constants for n. If the search is stopped between two rounds,
+VERDICT_STOPPED is returned. */
+static enum verdict
+miller_rabin (const mpz_t n, int k, enum boolean prefilter, gmp_randstate_t random, struct scratch_t *scratch)
 {
+#if FIXED_WIDTH
+	if (mpz_sizeinbase (n, 2) <= 64)
+		return u64_is_prime (mpz_get_ui (n)) ? VERDICT_PROBABLE_PRIME : VERDICT_COMPOSITE;
+#endif
+	
 	/* Write n - 1 as 2^s*d with d odd by factoring powers of 2 from n - 1. */
-	uint64_t s = 0;
-	mpz_t d, a, x, tmp;
-	mpz_inits (d, a, x, tmp, NULL);
-	mpz_sub_ui (d, n, 1); // d = n - 1
+	uint64_t s;
+	enum boolean probably_prime = TRUE;
+	mpz_ptr d = scratch->d, a = scratch->a, x = scratch->x, n_minus_1 = scratch->n_minus_1;
+	mpz_sub_ui (n_minus_1, n, 1);
+	s = mpz_scan1 (n_minus_1, 0);
+	mpz_tdiv_q_2exp (d, n_minus_1, s); // d = (n - 1) / 2^s
+	scratch->mont.ready = FALSE;
 	
-	while (mpz_even_p (d))
+	if (prefilter)
 	{
-		mpz_tdiv_q_2exp (d, d, 1); // d /= 2
-		++s;
+		mpz_set_ui (a, 2);
+		probably_prime = strong_probable_prime (n, a, d, s, n_minus_1, x, NULL);
 	}
 	
-	for (int i = 0; i < k; ++i)
+	for (int i = 0; i < k && probably_prime; ++i)
 	{
-		uint64_t r;
+		/* A candidate which is not tested to the end gets no verdict. */
+		if (atomic_load_explicit (scratch->stop, memory_order_relaxed))
+			return VERDICT_STOPPED;
 		
 		/* Generate random number a in range [2, n - 2]. */
-		mpz_set (tmp, n); // tmp = n
-		mpz_sub_ui (tmp, tmp, 4); // tmp -= 4
-		pthread_mutex_lock (rand_state_mutex);
-		mpz_urandomm (a, random, tmp); // a in [0, n - 4]
-		pthread_mutex_unlock (rand_state_mutex);
+		if (scratch->stream_pending)
+		{
+			seed_chunk_stream (random, scratch->pending_seed, scratch->pending_index, scratch->pending_chunk, scratch->stream_seed);
+			scratch->stream_pending = FALSE;
+		}
+		mpz_sub_ui (x, n, 4); // x = n - 4
+		mpz_urandomm (a, random, x); // a in [0, n - 4]
 		mpz_add_ui (a, a, 2); // a in [2, n - 2]
 		
-		/* x = a^d % n */
-		mpz_powm (x, a, d, n);
-		
-		mpz_add_ui (tmp, tmp, 3); // tmp = n - 1
-		
-		if (!mpz_cmp_ui (x, 1) || !mpz_cmp (x, tmp)) // if (x == 1 || x == n - 1)
-			continue;
-		for (r = 1; r < s; ++r)
+		probably_prime = strong_probable_prime (n, a, d, s, n_minus_1, x, &scratch->mont);
+	}
+	return probably_prime ? VERDICT_PROBABLE_PRIME : VERDICT_COMPOSITE;
+}
+
+/* This function halves x modulo the odd integer n, leaving the result in [0, n). */
+static void
+half_mod (mpz_t x, const mpz_t n)
+{
+	mpz_mod (x, x, n);
+	if (mpz_odd_p (x))
+		mpz_add (x, x, n);
+	mpz_tdiv_q_2exp (x, x, 1);
+}
+
+/* This function performs the strong Lucas probable prime test on an odd integer n above 3, with the parameters chosen
+by Selfridge's method: D is the first of 5, -7, 9, -11, 13, ... with Jacobi symbol (D/n) = -1, P = 1 and Q = (1 - D) / 4.
+With n + 1 = 2^s*d and d odd, n is a strong Lucas probable prime if U_d = 0 mod n, or V_(2^r*d) = 0 mod n for some
+r < s. The terms are found from the bits of d, with the doubling U_2k = U_k*V_k, V_2k = V_k^2 - 2Q^k, and the step
+U_k+1 = (P*U_k + V_k) / 2, V_k+1 = (D*U_k + P*V_k) / 2. */
+static enum boolean
+strong_lucas (const mpz_t n, struct scratch_t *scratch)
+{
+	mpz_ptr d = scratch->d, t = scratch->a, x = scratch->x, u = scratch->u, v = scratch->v, q_power = scratch->q_power;
+	long D = 5;
+	for (;; D = D > 0 ? -D - 2 : -D + 2)
+	{
+		const int jacobi = mpz_si_kronecker (D, n);
+		if (jacobi == -1)
+			break;
+		if (!jacobi && mpz_cmpabs_ui (n, labs (D)))
+			return FALSE; // n has the factor |D|
+		if (D == 13 && mpz_perfect_square_p (n))
+			return FALSE; // (D/n) is never -1 for a square, so the search would not end
+	}
+	const long Q = (1 - D) / 4;
+	
+	mpz_add_ui (d, n, 1);
+	const uint64_t s = mpz_scan1 (d, 0);
+	mpz_tdiv_q_2exp (d, d, s); // d = (n + 1) / 2^s
+	mpz_set_ui (u, 1); // U_1
+	mpz_set_ui (v, 1); // V_1 = P
+	mpz_set_si (q_power, Q);
+	mpz_mod (q_power, q_power, n); // Q^1
+	for (long bit = (long)mpz_sizeinbase (d, 2) - 2; bit >= 0; --bit)
+	{
+		mpz_mul (x, u, v);
+		mpz_mod (u, x, n);
+		mpz_mul (x, v, v);
+		mpz_submul_ui (x, q_power, 2);
+		mpz_mod (v, x, n);
+		mpz_mul (x, q_power, q_power);
+		mpz_mod (q_power, x, n);
+		if (mpz_tstbit (d, bit))
+		{
+			mpz_mul_si (t, u, D);
+			mpz_add (t, t, v);
+			mpz_add (u, u, v);
+			half_mod (u, n);
+			half_mod (t, n);
+			mpz_swap (v, t);
+			mpz_mul_si (x, q_power, Q);
+			mpz_mod (q_power, x, n);
+		}
+	}
+	
+	if (!mpz_sgn (u) || !mpz_sgn (v))
+		return TRUE;
+	for (uint64_t r = 1; r < s; ++r)
+	{
+		mpz_mul (x, v, v);
+		mpz_submul_ui (x, q_power, 2);
+		mpz_mod (v, x, n);
+		if (!mpz_sgn (v))
+			return TRUE;
+		mpz_mul (x, q_power, q_power);
+		mpz_mod (q_power, x, n);
+	}
+	return FALSE;
+}
+
+/* This function performs the Baillie-PSW test on an odd integer n above 3: the Miller-Rabin round with base 2,
+followed by the strong Lucas test if n passes it. No composite is known to pass both, and the pair costs about
+three rounds of the Miller-Rabin test. */
+static enum boolean
+baillie_psw (const mpz_t n, struct scratch_t *scratch)
+{
+#if FIXED_WIDTH
+	if (mpz_sizeinbase (n, 2) <= 64)
+		return u64_is_prime (mpz_get_ui (n));
+#endif
+	
+	mpz_ptr d = scratch->d, a = scratch->a, x = scratch->x, n_minus_1 = scratch->n_minus_1;
+	mpz_sub_ui (n_minus_1, n, 1);
+	const uint64_t s = mpz_scan1 (n_minus_1, 0);
+	mpz_tdiv_q_2exp (d, n_minus_1, s); // d = (n - 1) / 2^s
+	mpz_set_ui (a, 2);
+	return strong_probable_prime (n, a, d, s, n_minus_1, x, NULL) && strong_lucas (n, scratch);
+}
+
+/* This function tests an odd integer n above 3 with the chosen engine. The Miller-Rabin test uses the precision k and
+the prefilter, which the Baillie-PSW test does not need. Only the Miller-Rabin test can be stopped before its verdict. */
+static enum verdict
+probable_prime (const mpz_t n, enum primality_test test, int k, enum boolean prefilter, gmp_randstate_t random, struct scratch_t *scratch)
+{
+	if (test == TEST_BPSW)
+		return baillie_psw (n, scratch) ? VERDICT_PROBABLE_PRIME : VERDICT_COMPOSITE;
+	return miller_rabin (n, k, prefilter, random, scratch);
+}
+
+/* Outcomes of trial division of a candidate by the offset primes. */
+enum trial_result {TRIAL_COMPOSITE, TRIAL_PRIME, TRIAL_UNDECIDED};
+
+/* This function performs trial division of n by the offset primes of a table, a group at a time, which settles n if it
+has a factor among them or is below the square of one of them. Otherwise n is odd and above 3, as the Miller-Rabin test needs. */
+static enum trial_result
+trial_division (const struct offset_table_t *table, const mpz_t n)
+{
+	if (mpz_cmp_ui (n, 3) <= 0)
+		return mpz_cmp_ui (n, 2) >= 0 ? TRIAL_PRIME : TRIAL_COMPOSITE;
+	if (mpz_even_p (n))
+		return TRIAL_COMPOSITE;
+	
+	for (long i = 0, g = 0; i < table->num_offsets; ++g)
+	{
+		const unsigned long remainder = mpz_tdiv_ui (n, table->groups[g]);
+		for (const long end = i + table->group_sizes[g]; i < end; ++i)
+		{
+			const unsigned long p = table->primes[i];
+			if (remainder % p == 0)
+				return mpz_cmp_ui (n, p) == 0 ? TRIAL_PRIME : TRIAL_COMPOSITE;
+			/* An offset prime can be as large as 2^31 - 1, so where unsigned long has 32 bits, its square only fits for the
+			primes below 2^16, and n is only compared with the squares of those. */
+			if ((ULONG_MAX > 0xFFFFFFFFUL || p <= 0xFFFF) && mpz_cmp_ui (n, p * p) < 0)
+				return TRIAL_PRIME;
+		}
+	}
+	return TRIAL_UNDECIDED;
+}
+
+/* This function computes the bounds used to generate starting points with a certain number of digits:
+low = 1 followed by (num_digits - 1) zeroes, and range = 45 followed by (num_digits - 2) zeroes. */
+static void
+init_start_bounds (mpz_t low, mpz_t range, long num_digits)
+{
+	mpz_ui_pow_ui (low, BASE, num_digits - 1);
+	mpz_ui_pow_ui (range, BASE, num_digits - 2);
+	mpz_mul_ui (range, range, 45);
+}
+
+/* This method generates a random odd integer with a certain number of digits in the parameter n to be used as a starting point. */
+static void
+gen_start (mpz_t n, const mpz_t low, const mpz_t range, gmp_randstate_t random)
+{
+	mpz_urandomm (n, random, range); // n in [0, 44999...]
+	mpz_mul_2exp (n, n, 1); // n *= 2 -> n in [0, 8999... - 1]
+	mpz_add (n, n, low); // n in [1000... , 999... - 1] (set of all even integers with specified number of digits)
+	mpz_add_ui (n, n, 1); // ++n
+}
+
+/* This method generates a random odd integer with a certain number of bits in the parameter n to be used as a starting point.
+The random bits are generated directly, and the top and bottom bits are then set to fix the length and make n odd. */
+static void
+gen_start_bits (mpz_t n, long num_bits, gmp_randstate_t random)
+{
+	mpz_urandomb (n, random, num_bits);
+	mpz_setbit (n, num_bits - 1);
+	mpz_setbit (n, 0);
+}
+
+/* This function groups consecutive offset primes of a table into products which fit in an unsigned long, so that the
+offsets of a starting point can be found with one bignum division per group rather than one per prime. */
+static void
+init_offset_groups (struct offset_table_t *table)
+{
+	const long num_offsets = table->num_offsets;
+	const uint32_t *offset_primes = table->primes;
+	table->groups = malloc (num_offsets * sizeof (unsigned long));
+	table->group_sizes = malloc (num_offsets * sizeof (unsigned char));
+	if (!table->groups || !table->group_sizes)
+	{
+		fprintf (stderr, "Error: failure to allocate offset groups.\n");
+		exit (EXIT_FAILURE);
+	}
+	table->num_groups = 0;
+	for (long i = 0; i < num_offsets; ++table->num_groups)
+	{
+		unsigned long product = offset_primes[i++];
+		unsigned char size = 1;
+		while (i < num_offsets && product <= ULONG_MAX / offset_primes[i])
+		{
+			product *= offset_primes[i++];
+			++size;
+		}
+		table->groups[table->num_groups] = product;
+		table->group_sizes[table->num_groups] = size;
+	}
+}
+
+/* This function initializes the offsets from the starting point (a random odd integer with the specified number of digits).
+The offset o of an odd integer n modulo a low prime p is n / 2 mod p, so that n + 2j is divisible by p when j = -o mod p.
+Then 2(n + 2j) + 1 = 4(o + j) + 1 mod p is divisible by p when j = -(o + 1/4) mod p, so the safe offsets are o + 1/4 mod p,
+where 1/4 is the inverse of 4 mod p, the square of the inverse (p + 1) / 2 of 2. */
+static void
+offset_init (const mpz_t start_point, struct sieve_t *sieve)
+{
+	const struct offset_table_t *table = sieve->table;
+	for (long i = 0, g = 0; i < table->num_offsets; ++g)
+	{
+		/* First take the starting point mod the product of the group, which leaves the same remainder mod each low
+		prime in the group as the starting point itself, then use this value to find the offset. See readme for explanation. */
+		const unsigned long remainder = mpz_tdiv_ui (start_point, table->groups[g]);
+		for (const long end = i + table->group_sizes[g]; i < end; ++i)
 		{
-			mul_mod (x, x, x, n); // x = x * x % n
-			if (!mpz_cmp_ui (x, 1)) // if (x == 1)
+			const uint32_t p = table->primes[i];
+			uint32_t offset = (uint32_t)(remainder % p);
+			offset = (offset + (offset % 2) * p) / 2;
+			if (i < table->num_offsets8)
+				sieve->offsets8[i] = (uint8_t)offset;
+			else if (i < table->num_offsets16)
+				sieve->offsets16[i - table->num_offsets8] = (uint16_t)offset;
+			else
+				sieve->offsets32[i - table->num_offsets16] = offset;
+			if (!sieve->safe_offsets8)
+				continue;
+			const uint64_t half = (p + 1) / 2;
+			const uint32_t safe_offset = (uint32_t)((offset + half * half % p) % p);
+			if (i < table->num_offsets8)
+				sieve->safe_offsets8[i] = (uint8_t)safe_offset;
+			else if (i < table->num_offsets16)
+				sieve->safe_offsets16[i - table->num_offsets8] = (uint16_t)safe_offset;
+			else
+				sieve->safe_offsets32[i - table->num_offsets16] = safe_offset;
+		}
+	}
+}
+
+/* The following functions advance count offsets by one window: with the wrap w = p - (window mod p), the new offset
+(o + window) mod p is o - w if o >= w, and o - w + p otherwise. Each function computes o - w for a vector of offsets,
+compares o with w, and adds p in the lanes where o < w. The variant for the processor is chosen in select_advance_offsets. */
+
+/* These functions advance the offsets one at a time, for processors without a vector variant and for the leftover offsets. */
+static void
+advance_offsets8_scalar (uint8_t *offsets, const uint8_t *primes, const uint8_t *wraps, long count)
+{
+	for (long i = 0; i < count; ++i)
+		offsets[i] = offsets[i] >= wraps[i] ? offsets[i] - wraps[i] : offsets[i] - wraps[i] + primes[i];
+}
+
+static void
+advance_offsets16_scalar (uint16_t *offsets, const uint16_t *primes, const uint16_t *wraps, long count)
+{
+	for (long i = 0; i < count; ++i)
+		offsets[i] = offsets[i] >= wraps[i] ? offsets[i] - wraps[i] : offsets[i] - wraps[i] + primes[i];
+}
+
+static void
+advance_offsets32_scalar (uint32_t *offsets, const uint32_t *primes, const uint32_t *wraps, long count)
+{
+	for (long i = 0; i < count; ++i)
+		offsets[i] = offsets[i] >= wraps[i] ? offsets[i] - wraps[i] : offsets[i] - wraps[i] + primes[i];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* SSE2 has no unsigned 8 or 16 bit comparison, but w - o saturates to 0 exactly when o >= w. The offset primes are below
+2^31, so the signed 32 bit comparison is correct for the 32 bit offsets. */
+__attribute__ ((target ("sse2"))) static void
+advance_offsets8_sse2 (uint8_t *offsets, const uint8_t *primes, const uint8_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i o = _mm_loadu_si128 ((const __m128i *)(offsets + i));
+		const __m128i w = _mm_loadu_si128 ((const __m128i *)(wraps + i));
+		const __m128i p = _mm_loadu_si128 ((const __m128i *)(primes + i));
+		const __m128i at_least_wrap = _mm_cmpeq_epi8 (_mm_subs_epu8 (w, o), _mm_setzero_si128 ());
+		_mm_storeu_si128 ((__m128i *)(offsets + i), _mm_add_epi8 (_mm_sub_epi8 (o, w), _mm_andnot_si128 (at_least_wrap, p)));
+	}
+	advance_offsets8_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+__attribute__ ((target ("sse2"))) static void
+advance_offsets16_sse2 (uint16_t *offsets, const uint16_t *primes, const uint16_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i o = _mm_loadu_si128 ((const __m128i *)(offsets + i));
+		const __m128i w = _mm_loadu_si128 ((const __m128i *)(wraps + i));
+		const __m128i p = _mm_loadu_si128 ((const __m128i *)(primes + i));
+		const __m128i at_least_wrap = _mm_cmpeq_epi16 (_mm_subs_epu16 (w, o), _mm_setzero_si128 ());
+		_mm_storeu_si128 ((__m128i *)(offsets + i), _mm_add_epi16 (_mm_sub_epi16 (o, w), _mm_andnot_si128 (at_least_wrap, p)));
+	}
+	advance_offsets16_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+__attribute__ ((target ("sse2"))) static void
+advance_offsets32_sse2 (uint32_t *offsets, const uint32_t *primes, const uint32_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i o = _mm_loadu_si128 ((const __m128i *)(offsets + i));
+		const __m128i w = _mm_loadu_si128 ((const __m128i *)(wraps + i));
+		const __m128i p = _mm_loadu_si128 ((const __m128i *)(primes + i));
+		const __m128i below_wrap = _mm_cmpgt_epi32 (w, o);
+		_mm_storeu_si128 ((__m128i *)(offsets + i), _mm_add_epi32 (_mm_sub_epi32 (o, w), _mm_and_si128 (below_wrap, p)));
+	}
+	advance_offsets32_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+__attribute__ ((target ("avx2"))) static void
+advance_offsets8_avx2 (uint8_t *offsets, const uint8_t *primes, const uint8_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m256i o = _mm256_loadu_si256 ((const __m256i *)(offsets + i));
+		const __m256i w = _mm256_loadu_si256 ((const __m256i *)(wraps + i));
+		const __m256i p = _mm256_loadu_si256 ((const __m256i *)(primes + i));
+		const __m256i at_least_wrap = _mm256_cmpeq_epi8 (_mm256_max_epu8 (o, w), o);
+		_mm256_storeu_si256 ((__m256i *)(offsets + i), _mm256_add_epi8 (_mm256_sub_epi8 (o, w), _mm256_andnot_si256 (at_least_wrap, p)));
+	}
+	advance_offsets8_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+__attribute__ ((target ("avx2"))) static void
+advance_offsets16_avx2 (uint16_t *offsets, const uint16_t *primes, const uint16_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m256i o = _mm256_loadu_si256 ((const __m256i *)(offsets + i));
+		const __m256i w = _mm256_loadu_si256 ((const __m256i *)(wraps + i));
+		const __m256i p = _mm256_loadu_si256 ((const __m256i *)(primes + i));
+		const __m256i at_least_wrap = _mm256_cmpeq_epi16 (_mm256_max_epu16 (o, w), o);
+		_mm256_storeu_si256 ((__m256i *)(offsets + i), _mm256_add_epi16 (_mm256_sub_epi16 (o, w), _mm256_andnot_si256 (at_least_wrap, p)));
+	}
+	advance_offsets16_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+__attribute__ ((target ("avx2"))) static void
+advance_offsets32_avx2 (uint32_t *offsets, const uint32_t *primes, const uint32_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i o = _mm256_loadu_si256 ((const __m256i *)(offsets + i));
+		const __m256i w = _mm256_loadu_si256 ((const __m256i *)(wraps + i));
+		const __m256i p = _mm256_loadu_si256 ((const __m256i *)(primes + i));
+		const __m256i below_wrap = _mm256_cmpgt_epi32 (w, o);
+		_mm256_storeu_si256 ((__m256i *)(offsets + i), _mm256_add_epi32 (_mm256_sub_epi32 (o, w), _mm256_and_si256 (below_wrap, p)));
+	}
+	advance_offsets32_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+/* AVX-512 compares into a mask register, and p is added only in the lanes selected by the mask. */
+__attribute__ ((target ("avx512f,avx512bw"))) static void
+advance_offsets8_avx512 (uint8_t *offsets, const uint8_t *primes, const uint8_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 64 <= count; i += 64)
+	{
+		const __m512i o = _mm512_loadu_si512 ((const void *)(offsets + i));
+		const __m512i w = _mm512_loadu_si512 ((const void *)(wraps + i));
+		const __m512i p = _mm512_loadu_si512 ((const void *)(primes + i));
+		const __m512i t = _mm512_sub_epi8 (o, w);
+		_mm512_storeu_si512 ((void *)(offsets + i), _mm512_mask_add_epi8 (t, _mm512_cmplt_epu8_mask (o, w), t, p));
+	}
+	advance_offsets8_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+__attribute__ ((target ("avx512f,avx512bw"))) static void
+advance_offsets16_avx512 (uint16_t *offsets, const uint16_t *primes, const uint16_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m512i o = _mm512_loadu_si512 ((const void *)(offsets + i));
+		const __m512i w = _mm512_loadu_si512 ((const void *)(wraps + i));
+		const __m512i p = _mm512_loadu_si512 ((const void *)(primes + i));
+		const __m512i t = _mm512_sub_epi16 (o, w);
+		_mm512_storeu_si512 ((void *)(offsets + i), _mm512_mask_add_epi16 (t, _mm512_cmplt_epu16_mask (o, w), t, p));
+	}
+	advance_offsets16_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+__attribute__ ((target ("avx512f"))) static void
+advance_offsets32_avx512 (uint32_t *offsets, const uint32_t *primes, const uint32_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m512i o = _mm512_loadu_si512 ((const void *)(offsets + i));
+		const __m512i w = _mm512_loadu_si512 ((const void *)(wraps + i));
+		const __m512i p = _mm512_loadu_si512 ((const void *)(primes + i));
+		const __m512i t = _mm512_sub_epi32 (o, w);
+		_mm512_storeu_si512 ((void *)(offsets + i), _mm512_mask_add_epi32 (t, _mm512_cmplt_epu32_mask (o, w), t, p));
+	}
+	advance_offsets32_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+#elif defined(__ARM_NEON)
+static void
+advance_offsets8_neon (uint8_t *offsets, const uint8_t *primes, const uint8_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const uint8x16_t o = vld1q_u8 (offsets + i);
+		const uint8x16_t w = vld1q_u8 (wraps + i);
+		const uint8x16_t p = vld1q_u8 (primes + i);
+		vst1q_u8 (offsets + i, vaddq_u8 (vsubq_u8 (o, w), vandq_u8 (vcltq_u8 (o, w), p)));
+	}
+	advance_offsets8_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+static void
+advance_offsets16_neon (uint16_t *offsets, const uint16_t *primes, const uint16_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const uint16x8_t o = vld1q_u16 (offsets + i);
+		const uint16x8_t w = vld1q_u16 (wraps + i);
+		const uint16x8_t p = vld1q_u16 (primes + i);
+		vst1q_u16 (offsets + i, vaddq_u16 (vsubq_u16 (o, w), vandq_u16 (vcltq_u16 (o, w), p)));
+	}
+	advance_offsets16_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+
+static void
+advance_offsets32_neon (uint32_t *offsets, const uint32_t *primes, const uint32_t *wraps, long count)
+{
+	long i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const uint32x4_t o = vld1q_u32 (offsets + i);
+		const uint32x4_t w = vld1q_u32 (wraps + i);
+		const uint32x4_t p = vld1q_u32 (primes + i);
+		vst1q_u32 (offsets + i, vaddq_u32 (vsubq_u32 (o, w), vandq_u32 (vcltq_u32 (o, w), p)));
+	}
+	advance_offsets32_scalar (offsets + i, primes + i, wraps + i, count - i);
+}
+#endif
+
+static void (*advance_offsets8) (uint8_t *, const uint8_t *, const uint8_t *, long) = advance_offsets8_scalar;
+static void (*advance_offsets16) (uint16_t *, const uint16_t *, const uint16_t *, long) = advance_offsets16_scalar;
+static void (*advance_offsets32) (uint32_t *, const uint32_t *, const uint32_t *, long) = advance_offsets32_scalar;
+
+/* This function chooses the variant of the functions which advance the offsets that is best supported by the processor.
+It is run once, by the first call to init_offset_wraps. */
+static void
+select_advance_offsets ()
+{
+	#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init ();
+		if (__builtin_cpu_supports ("avx512bw"))
+		{
+			advance_offsets8 = advance_offsets8_avx512;
+			advance_offsets16 = advance_offsets16_avx512;
+			advance_offsets32 = advance_offsets32_avx512;
+		}
+		else if (__builtin_cpu_supports ("avx2"))
+		{
+			advance_offsets8 = advance_offsets8_avx2;
+			advance_offsets16 = advance_offsets16_avx2;
+			advance_offsets32 = advance_offsets32_avx2;
+		}
+		else if (__builtin_cpu_supports ("sse2"))
+		{
+			advance_offsets8 = advance_offsets8_sse2;
+			advance_offsets16 = advance_offsets16_sse2;
+			advance_offsets32 = advance_offsets32_sse2;
+		}
+	#elif defined(__ARM_NEON)
+		advance_offsets8 = advance_offsets8_neon;
+		advance_offsets16 = advance_offsets16_neon;
+		advance_offsets32 = advance_offsets32_neon;
+	#endif
+}
+
+/* This function computes the narrow copies of the offset primes of a table and the wraps of all of them for the window of the table. */
+static void
+init_offset_wraps (struct offset_table_t *table)
+{
+	static pthread_once_t selected = PTHREAD_ONCE_INIT;
+	pthread_once (&selected, select_advance_offsets);
+	
+	const long num_offsets = table->num_offsets;
+	const uint32_t *offset_primes = table->primes;
+	long num_offsets8, num_offsets16;
+	for (num_offsets8 = 0; num_offsets8 < num_offsets && offset_primes[num_offsets8] < 256; ++num_offsets8);
+	for (num_offsets16 = num_offsets8; num_offsets16 < num_offsets && offset_primes[num_offsets16] < 65536; ++num_offsets16);
+	table->num_offsets8 = num_offsets8;
+	table->num_offsets16 = num_offsets16;
+	table->primes8 = malloc (num_offsets8 + 1);
+	table->wraps8 = malloc (num_offsets8 + 1);
+	table->primes16 = malloc ((num_offsets16 - num_offsets8 + 1) * sizeof (uint16_t));
+	table->wraps16 = malloc ((num_offsets16 - num_offsets8 + 1) * sizeof (uint16_t));
+	table->wraps32 = malloc ((num_offsets - num_offsets16 + 1) * sizeof (uint32_t));
+	if (!table->primes8 || !table->wraps8 || !table->primes16 || !table->wraps16 || !table->wraps32)
+	{
+		fprintf (stderr, "Error: failure to allocate offset wraps.\n");
+		exit (EXIT_FAILURE);
+	}
+	for (long i = 0; i < num_offsets; ++i)
+	{
+		const uint32_t wrap = offset_primes[i] - table->window % offset_primes[i];
+		if (i < num_offsets8)
+		{
+			table->primes8[i] = (uint8_t)offset_primes[i];
+			table->wraps8[i] = (uint8_t)wrap;
+		}
+		else if (i < num_offsets16)
+		{
+			table->primes16[i - num_offsets8] = (uint16_t)offset_primes[i];
+			table->wraps16[i - num_offsets8] = (uint16_t)wrap;
+		}
+		else
+			table->wraps32[i - num_offsets16] = wrap;
+	}
+}
+
+/* This function frees the tables allocated by init_offset_wraps. */
+static void
+free_offset_wraps (struct offset_table_t *table)
+{
+	free (table->primes8);
+	free (table->wraps8);
+	free (table->primes16);
+	free (table->wraps16);
+	free (table->wraps32);
+}
+
+/* This function builds a table of offset primes, either a given number of them or all of those up to a given limit (when
+sieve_limit is not 0), for sieving windows of a given size, loading the primes from the table file if table_name is not NULL. */
+static void
+table_init (struct offset_table_t *table, const char *table_name, const long num_offsets, const long sieve_limit, const long window)
+{
+	table->window = window;
+	load_offsets (table, table_name, num_offsets, sieve_limit);
+	init_offset_groups (table);
+	init_offset_wraps (table);
+}
+
+/* This function frees a table built by table_init. */
+static void
+table_free (struct offset_table_t *table)
+{
+	free_offsets (table);
+	free (table->groups);
+	free (table->group_sizes);
+	free_offset_wraps (table);
+}
+
+/* This function returns a copy of an array, or exits if there is no memory for it. */
+static void *
+duplicate (const void *array, size_t size)
+{
+	void *copy = malloc (size ? size : 1);
+	if (!copy)
+	{
+		fprintf (stderr, "Error: failure to allocate table copy.\n");
+		exit (EXIT_FAILURE);
+	}
+	return memcpy (copy, array, size);
+}
+
+/* This function copies a table built by table_init into new memory. The pages of the copy are allocated where the calling
+thread runs when it first touches them, so a worker running on a NUMA node gets a copy in the memory of that node.
+The copy is freed by table_free. */
+static void
+table_copy (struct offset_table_t *copy, const struct offset_table_t *table)
+{
+	*copy = *table;
+	copy->map = NULL;
+	copy->primes = duplicate (table->primes, table->num_offsets * sizeof (uint32_t));
+	copy->groups = duplicate (table->groups, table->num_groups * sizeof (unsigned long));
+	copy->group_sizes = duplicate (table->group_sizes, table->num_groups);
+	copy->primes8 = duplicate (table->primes8, table->num_offsets8 + 1);
+	copy->wraps8 = duplicate (table->wraps8, table->num_offsets8 + 1);
+	copy->primes16 = duplicate (table->primes16, (table->num_offsets16 - table->num_offsets8 + 1) * sizeof (uint16_t));
+	copy->wraps16 = duplicate (table->wraps16, (table->num_offsets16 - table->num_offsets8 + 1) * sizeof (uint16_t));
+	copy->wraps32 = duplicate (table->wraps32, (table->num_offsets - table->num_offsets16 + 1) * sizeof (uint32_t));
+}
+
+/* This function rounds a number of bytes up to a whole number of cache lines. */
+static size_t
+cache_lines (size_t num_bytes)
+{
+	return (num_bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+/* This function allocates the offsets and the bitmap of a sieve over a table for starting points of at most max_bits bits,
+along with the safe offsets if safe is set. The offsets of each width and the bitmap are laid out one after the other
+in a single block, each starting on its own cache line. */
+static void
+sieve_init (struct sieve_t *sieve, const struct offset_table_t *table, mp_bitcnt_t max_bits, enum boolean safe)
+{
+	const size_t size8 = cache_lines (table->num_offsets8);
+	const size_t size16 = cache_lines ((table->num_offsets16 - table->num_offsets8) * sizeof (uint16_t));
+	const size_t size32 = cache_lines ((table->num_offsets - table->num_offsets16) * sizeof (uint32_t));
+	const size_t offsets_size = size8 + size16 + size32;
+	const size_t safe_size = safe ? offsets_size : 0;
+	if (posix_memalign (&sieve->memory, CACHE_LINE_SIZE, offsets_size + safe_size + table->window / 8))
+	{
+		fprintf (stderr, "Error: failure to allocate sieve.\n");
+		exit (EXIT_FAILURE);
+	}
+	sieve->table = table;
+	sieve->offsets8 = (uint8_t *)sieve->memory;
+	sieve->offsets16 = (uint16_t *)((char *)sieve->memory + size8);
+	sieve->offsets32 = (uint32_t *)((char *)sieve->memory + size8 + size16);
+	sieve->safe_offsets8 = safe ? (uint8_t *)((char *)sieve->memory + offsets_size) : NULL;
+	sieve->safe_offsets16 = safe ? (uint16_t *)((char *)sieve->memory + offsets_size + size8) : NULL;
+	sieve->safe_offsets32 = safe ? (uint32_t *)((char *)sieve->memory + offsets_size + size8 + size16) : NULL;
+	sieve->bits = (uint64_t *)((char *)sieve->memory + offsets_size + safe_size);
+	mpz_init2 (sieve->window_start, max_bits);
+	sieve->sieved = 0;
+}
+
+/* This function frees the memory held by a sieve. */
+static void
+sieve_clear (struct sieve_t *sieve)
+{
+	free (sieve->memory);
+	mpz_clear (sieve->window_start);
+}
+
+/* This function marks the bits of the current window which a set of offsets says are divisible by one of the low primes.
+Bit j of the window stands for window_start + 2 * j. Since window_start is 2 * offset modulo the low prime,
+the first marked bit for each prime is the one which brings the offset back around to 0. */
+static void
+mark_offsets (struct sieve_t *sieve, const uint8_t *offsets8, const uint16_t *offsets16, const uint32_t *offsets32)
+{
+	const struct offset_table_t *table = sieve->table;
+	const uint32_t window = (uint32_t)table->window;
+	for (long i = 0; i < table->num_offsets8; ++i)
+	{
+		const uint32_t p = table->primes8[i];
+		for (uint32_t j = offsets8[i] ? p - offsets8[i] : 0; j < window; j += p)
+			sieve->bits[j / 64] |= (uint64_t)1 << (j % 64);
+	}
+	for (long i = 0; i < table->num_offsets16 - table->num_offsets8; ++i)
+	{
+		const uint32_t p = table->primes16[i];
+		for (uint32_t j = offsets16[i] ? p - offsets16[i] : 0; j < window; j += p)
+			sieve->bits[j / 64] |= (uint64_t)1 << (j % 64);
+	}
+	for (long i = 0; i < table->num_offsets - table->num_offsets16; ++i)
+	{
+		const uint32_t p = table->primes[table->num_offsets16 + i];
+		for (uint32_t j = offsets32[i] ? p - offsets32[i] : 0; j < window; j += p)
+			sieve->bits[j / 64] |= (uint64_t)1 << (j % 64);
+	}
+}
+
+/* This function marks every odd number in the current window which is divisible by one of the low primes,
+and when searching for safe primes, every odd number q for which 2q + 1 is. */
+static void
+sieve_window (struct sieve_t *sieve)
+{
+	memset (sieve->bits, 0, sieve->table->window / 8);
+	mark_offsets (sieve, sieve->offsets8, sieve->offsets16, sieve->offsets32);
+	if (sieve->safe_offsets8)
+		mark_offsets (sieve, sieve->safe_offsets8, sieve->safe_offsets16, sieve->safe_offsets32);
+}
+
+/* This function moves the offsets forward by one window, so that they describe the start of the next window.
+The safe offsets move forward by the same amount, so they are advanced with the same wraps. */
+static void
+advance_offsets (struct sieve_t *sieve)
+{
+	const struct offset_table_t *table = sieve->table;
+	advance_offsets8 (sieve->offsets8, table->primes8, table->wraps8, table->num_offsets8);
+	advance_offsets16 (sieve->offsets16, table->primes16, table->wraps16, table->num_offsets16 - table->num_offsets8);
+	advance_offsets32 (sieve->offsets32, table->primes + table->num_offsets16, table->wraps32, table->num_offsets - table->num_offsets16);
+	if (!sieve->safe_offsets8)
+		return;
+	advance_offsets8 (sieve->safe_offsets8, table->primes8, table->wraps8, table->num_offsets8);
+	advance_offsets16 (sieve->safe_offsets16, table->primes16, table->wraps16, table->num_offsets16 - table->num_offsets8);
+	advance_offsets32 (sieve->safe_offsets32, table->primes + table->num_offsets16, table->wraps32, table->num_offsets - table->num_offsets16);
+}
+
+/* This function starts a sieve at a starting point (a random odd integer) by computing its offsets. The first window is sieved by next_test. */
+static void
+sieve_start (struct sieve_t *sieve, const mpz_t start_point)
+{
+	mpz_set (sieve->window_start, start_point);
+	offset_init (sieve->window_start, sieve);
+	sieve->position = -1;
+}
+
+/* This function moves a sieve from window number current to window number target of the search from a starting point,
+and sieves it. The offsets are advanced if the target is the next window, and computed afresh otherwise. */
+static void
+sieve_seek (struct sieve_t *sieve, const mpz_t start_point, long current, long target)
+{
+	const long window = sieve->table->window;
+	if (current >= 0 && target == current + 1)
+	{
+		mpz_add_ui (sieve->window_start, sieve->window_start, 2 * window);
+		advance_offsets (sieve);
+	}
+	else
+	{
+		mpz_set_ui (sieve->window_start, 2 * window);
+		mpz_mul_si (sieve->window_start, sieve->window_start, target);
+		mpz_add (sieve->window_start, sieve->window_start, start_point);
+		offset_init (sieve->window_start, sieve);
+	}
+	sieve_window (sieve);
+	sieve->position = 0;
+}
+
+/* This function finds the next odd number which should be tested, i.e. the next unmarked bit of the sieve,
+moving on to the next window when the current one has been used up. */
+static void
+next_test (mpz_t test_value, struct sieve_t *sieve)
+{
+	const long window = sieve->table->window;
+	if (sieve->position < 0)
+	{
+		sieve_window (sieve);
+		sieve->position = 0;
+	}
+	for (long first = sieve->position;;)
+	{
+		while (sieve->position < window)
+		{
+			/* Skip over marked bits a whole word at a time. */
+			uint64_t unmarked = ~sieve->bits[sieve->position / 64] >> (sieve->position % 64);
+			if (unmarked)
+			{
+				sieve->position += __builtin_ctzll (unmarked);
+				mpz_add_ui (test_value, sieve->window_start, 2 * sieve->position);
+				++sieve->position;
+				sieve->sieved += sieve->position - first;
+				return;
+			}
+			sieve->position = (sieve->position / 64 + 1) * 64;
+		}
+		sieve->sieved += window - first;
+		mpz_add_ui (sieve->window_start, sieve->window_start, 2 * window);
+		advance_offsets (sieve);
+		sieve_window (sieve);
+		sieve->position = first = 0;
+	}
+}
+
+/* Indices of the nodes of the writer's queue which are not primes: the node which tells the writer to finish, and the
+mark after which it records the size of the output file for the checkpointer (see checkpoint_save). */
+enum result_marks {RESULT_FINISH = -1, RESULT_MARK = -2};
+
+/* The following structure contains one result for the writer, and is the node of the writer's queue. */
+struct result_t
+{
+	struct result_t *_Atomic next;
+	long index; // index of the prime, or one of result_marks for a node which is not a prime
+	size_t length;
+	char text[]; // the result as it is printed to the output file
+};
+
+/* The following structure contains the state of the writer, which is the only thread that writes to the output file.
+The workers hand results to the writer through a lock-free multiple producer, single consumer queue (an intrusive
+linked list in which producers swap themselves in at the head and the writer unlinks from the tail), and post to a
+semaphore for every result so that the writer can sleep while there is nothing to write. A second semaphore counts the
+room left in the queue, so that the workers wait for a slow reader of the output (such as a pipe) instead of piling up
+results in memory. The head, which the workers swap, and the tail, which only the writer touches, have cache lines of their own. */
+struct writer_t
+{
+	FILE *out_file;
+	enum boolean closed; // whether the reader of the output has gone away, after which results are dropped
+	atomic_long written; // number of results written and flushed
+	atomic_long bytes; // size of the output file after the last flush
+	sem_t room;
+	_Alignas (CACHE_LINE_SIZE) struct result_t *_Atomic head; // most recently pushed node
+	_Alignas (CACHE_LINE_SIZE) struct result_t *tail; // next node to be popped, only touched by the writer
+	struct result_t stub; // keeps the queue from ever being empty
+	sem_t available;
+	struct result_t mark; // pushed by the checkpointer, which waits on marked for the writer to reach it
+	long mark_bytes, mark_written; // size of the output file and number of results written at the mark
+	sem_t marked;
+	long sync_every; // number of results after which the output file is synced to disk, 0 to not count results
+	long sync_ms; // number of milliseconds after which a written result is synced to disk, 0 to not time results
+	pthread_t thread;
+};
+
+/* This function pushes a result onto the writer's queue. It never blocks, so the writer can use it to push the stub. */
+static void
+writer_push (struct writer_t *writer, struct result_t *result)
+{
+	atomic_store (&result->next, NULL);
+	struct result_t *previous = atomic_exchange (&writer->head, result);
+	atomic_store (&previous->next, result); // the writer cannot reach the result before this store
+	sem_post (&writer->available);
+}
+
+/* This function pops the oldest result from the writer's queue, or returns NULL if the oldest result is still being pushed. */
+static struct result_t *
+writer_pop (struct writer_t *writer)
+{
+	struct result_t *tail = writer->tail;
+	struct result_t *next = atomic_load (&tail->next);
+	if (tail == &writer->stub)
+	{
+		if (!next)
+			return NULL;
+		writer->tail = tail = next;
+		next = atomic_load (&tail->next);
+	}
+	if (next)
+	{
+		writer->tail = next;
+		return tail;
+	}
+	/* The tail is the last node, so it can only be popped after putting the stub behind it. */
+	if (tail != atomic_load (&writer->head))
+		return NULL;
+	writer_push (writer, &writer->stub);
+	while (sem_wait (&writer->available)) // the stub does not count as a result
+		continue; // interrupted by a signal
+	next = atomic_load (&tail->next);
+	if (next)
+	{
+		writer->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/* This function hands a result to the writer once there is room for it in the writer's queue. */
+static void
+writer_submit (struct writer_t *writer, struct result_t *result)
+{
+	while (sem_wait (&writer->room))
+		continue; // interrupted by a signal
+	writer_push (writer, result);
+}
+
+/* This function syncs the output file to disk. Output which cannot be synced, such as a pipe, is only flushed. */
+static void
+writer_sync (struct writer_t *writer)
+{
+	if (writer->closed)
+		return;
+	if (fflush (writer->out_file) || (fsync (fileno (writer->out_file)) && errno != EINVAL))
+	{
+		fprintf (stderr, "Error: failure to write output file.\n");
+		exit (EXIT_FAILURE);
+	}
+}
+
+/* This function handles a failure to write the output file. If the reader of the output has gone away (EPIPE), or a signal
+interrupted the writer while it was blocked on the reader, the workers are stopped and the rest of the results are dropped. */
+static void
+writer_failed (struct writer_t *writer)
+{
+	if (errno != EPIPE && errno != EINTR)
+	{
+		fprintf (stderr, "Error: failure to write output file.\n");
+		exit (EXIT_FAILURE);
+	}
+	writer->closed = TRUE;
+	stop_search (&stop_requested, STOP_CLOSED);
+}
+
+/* This function flushes the results written since the last flush to the output file, and counts them as written. */
+static void
+writer_flush (struct writer_t *writer, long *unflushed, long *unflushed_bytes)
+{
+	if (!writer->closed && fflush (writer->out_file))
+		writer_failed (writer);
+	if (!writer->closed)
+	{
+		atomic_fetch_add (&writer->bytes, *unflushed_bytes);
+		atomic_fetch_add (&writer->written, *unflushed);
+	}
+	*unflushed = *unflushed_bytes = 0;
+}
+
+/* This method defines the behavior of the writer thread: wait for results, write every result which is available in
+one batch, and flush the batch to the output file. Flushing each batch allows the program to be aborted without losing
+the primes which have already been found, and syncing according to sync_every and sync_ms makes them durable on disk. */
+static void *
+write_results (void *writer_args)
+{
+	struct writer_t *writer = (struct writer_t *)writer_args;
+	long unsynced = 0; // results written since the last sync
+	long unflushed = 0; // results written since the last flush
+	long unflushed_bytes = 0; // bytes written since the last flush
+	struct timespec deadline; // time by which the unsynced results must be synced when sync_ms is set
+	enum boolean finished = FALSE;
+	
+	/* The other threads block SIGINT, SIGTERM and SIGALRM, so that they interrupt the writer if it is blocked on a full pipe. */
+	sigset_t signals;
+	sigemptyset (&signals);
+	sigaddset (&signals, SIGINT);
+	sigaddset (&signals, SIGTERM);
+	sigaddset (&signals, SIGALRM);
+	pthread_sigmask (SIG_UNBLOCK, &signals, NULL);
+	
+	while (!finished)
+	{
+		/* Wait for a result, or for the deadline of the unsynced results to pass. */
+		if (unsynced && writer->sync_ms)
+		{
+			if (sem_timedwait (&writer->available, &deadline))
+			{
+				if (errno == ETIMEDOUT)
+				{
+					writer_sync (writer);
+					unsynced = 0;
+				}
+				continue;
+			}
+		}
+		else if (sem_wait (&writer->available))
+			continue;
+		
+		/* Write the result which was waited for and every other result which is already available. */
+		do
+		{
+			struct result_t *result;
+			while (!(result = writer_pop (writer)))
+				sched_yield (); // a worker is between swapping in its result and linking it
+			if (result->index == RESULT_FINISH)
+				finished = TRUE;
+			else if (result->index == RESULT_MARK)
+			{
+				writer_flush (writer, &unflushed, &unflushed_bytes);
+				writer->mark_bytes = atomic_load (&writer->bytes);
+				writer->mark_written = atomic_load (&writer->written);
+				sem_post (&writer->marked);
+				continue; // the mark belongs to the writer
+			}
+			else if (!writer->closed)
+			{
+				if (fwrite (result->text, 1, result->length, writer->out_file) < result->length)
+					writer_failed (writer);
+				++unflushed;
+				unflushed_bytes += result->length;
+				if (!unsynced++ && writer->sync_ms)
+				{
+					clock_gettime (CLOCK_REALTIME, &deadline);
+					deadline.tv_sec += writer->sync_ms / 1000;
+					deadline.tv_nsec += writer->sync_ms % 1000 * 1000000;
+					if (deadline.tv_nsec >= 1000000000)
+					{
+						deadline.tv_nsec -= 1000000000;
+						++deadline.tv_sec;
+					}
+				}
+			}
+			if (result->index >= 0)
+				sem_post (&writer->room);
+			free (result);
+		}
+		while (!finished && !sem_trywait (&writer->available));
+		
+		writer_flush (writer, &unflushed, &unflushed_bytes);
+		if (unsynced && (finished || (writer->sync_every && unsynced >= writer->sync_every)))
+		{
+			writer_sync (writer);
+			unsynced = 0;
+		}
+	}
+	return NULL;
+}
+
+/* This function opens the output file, which is truncated unless append is set, and starts the writer thread.
+The output file name "-" stands for standard output. */
+static void
+writer_start (struct writer_t *writer, const char *out_file_name, enum boolean append, long sync_every, long sync_ms)
+{
+	writer->out_file = strcmp (out_file_name, "-") == 0 ? stdout : fopen (out_file_name, append ? "a" : "w");
+	if (!writer->out_file)
+	{
+		fprintf (stderr, "Error: failure to open output file.\n");
+		exit (EXIT_FAILURE);
+	}
+	setvbuf (writer->out_file, NULL, _IOFBF, WRITER_BUFFER_SIZE);
+	struct stat status;
+	atomic_init (&writer->bytes, append && !fstat (fileno (writer->out_file), &status) ? (long)status.st_size : 0);
+	atomic_init (&writer->stub.next, NULL);
+	atomic_init (&writer->head, &writer->stub);
+	writer->tail = &writer->stub;
+	writer->closed = FALSE;
+	atomic_init (&writer->written, 0);
+	sem_init (&writer->available, 0, 0);
+	sem_init (&writer->room, 0, WRITER_QUEUE_SIZE);
+	writer->mark.index = RESULT_MARK;
+	sem_init (&writer->marked, 0, 0);
+	writer->sync_every = sync_every;
+	writer->sync_ms = sync_ms;
+	int return_code = pthread_create (&writer->thread, NULL, write_results, (void *)writer);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+}
+
+/* This function tells the writer to finish once every result pushed so far has been written, waits for it, and closes the output file. */
+static void
+writer_finish (struct writer_t *writer)
+{
+	struct result_t *last = malloc (sizeof (struct result_t));
+	if (!last)
+	{
+		fprintf (stderr, "Error: failure to allocate result.\n");
+		exit (EXIT_FAILURE);
+	}
+	last->index = RESULT_FINISH;
+	writer_push (writer, last);
+	int return_code = pthread_join (writer->thread, NULL);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+	fclose (writer->out_file);
+	sem_destroy (&writer->available);
+	sem_destroy (&writer->room);
+	sem_destroy (&writer->marked);
+}
+
+/* The following structure contains the state of the progress reporter, a thread which periodically prints the rates
+at which the workers sieve and test candidates, read from their timers while they are running. */
+struct progress_t
+{
+	struct timer_set_t *timers;
+	long interval; // seconds between reports
+	sem_t finished; // posted when the workers are done
+	pthread_t thread;
+};
+
+/* This method defines the behavior of the progress reporter: every interval, print the rates since the last report. */
+static void *
+report_progress (void *progress_args)
+{
+	struct progress_t *progress = (struct progress_t *)progress_args;
+	long last[NUM_COUNTERS] = {0};
+	double last_time = timer_now ();
+	struct timespec deadline;
+	clock_gettime (CLOCK_REALTIME, &deadline);
+	
+	for (;;)
+	{
+		/* Wait for the interval to pass, or return once the workers are done. */
+		deadline.tv_sec += progress->interval;
+		int timed_out;
+		while ((timed_out = sem_timedwait (&progress->finished, &deadline)) && errno == EINTR)
+			continue;
+		if (!timed_out)
+			return NULL;
+		
+		long counts[NUM_COUNTERS];
+		for (int counter = 0; counter < NUM_COUNTERS; ++counter)
+			counts[counter] = timer_total_count (progress->timers, counter);
+		const double now = timer_now ();
+		const double elapsed = now - last_time;
+		fprintf (status_out, "Progress: %.0f candidates sieved/s, %.0f Miller-Rabin tests/s, %.0f rejections/s, %ld primes found\n",
+			(counts[COUNT_SIEVED] - last[COUNT_SIEVED]) / elapsed, (counts[COUNT_TESTS] - last[COUNT_TESTS]) / elapsed,
+			(counts[COUNT_REJECTED] - last[COUNT_REJECTED]) / elapsed, counts[COUNT_PRIMES]);
+		fflush (status_out);
+		memcpy (last, counts, sizeof (counts));
+		last_time = now;
+	}
+}
+
+/* This function starts the progress reporter. */
+static void
+progress_start (struct progress_t *progress, struct timer_set_t *timers, long interval)
+{
+	progress->timers = timers;
+	progress->interval = interval;
+	sem_init (&progress->finished, 0, 0);
+	int return_code = pthread_create (&progress->thread, NULL, report_progress, (void *)progress);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+}
+
+/* This function stops the progress reporter and waits for it. */
+static void
+progress_finish (struct progress_t *progress)
+{
+	sem_post (&progress->finished);
+	int return_code = pthread_join (progress->thread, NULL);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+	sem_destroy (&progress->finished);
+}
+
+/* The following structure contains the saved state of the search from one starting point: the number of primes found from
+it, the next odd integer to be examined, or 0 if the search has not started yet, and the number of searches from it when the
+workers cooperate (see cooperate). The worker on the starting point updates its slot under the lock of the slot when it starts
+the search and when it finds a prime, which the checkpointer takes to read a consistent state. In between, the worker only
+stores the number of odd integers it has passed since the position, so that no lock is taken for every candidate; the next odd
+integer to be examined is then the position plus twice that number. Each slot has cache lines of its own, since its worker
+stores to it after every candidate. */
+struct checkpoint_slot_t
+{
+	_Alignas (CACHE_LINE_SIZE) pthread_mutex_t lock;
+	enum boolean active; // whether the slot holds a starting point whose primes have not all been found
+	long start_index;
+	long found;
+	long search;
+	mpz_t position;
+	atomic_long passed; // odd integers passed since the position, stored without the lock
+};
+
+/* The following structure contains the state of a slot as copied by the checkpointer, which writes it out once the locks are released. */
+struct checkpoint_record_t
+{
+	long start_index;
+	long found;
+	long search;
+	mpz_t position;
+};
+
+/* The following structure contains the state of the checkpointer, which saves the state of the search to the checkpoint file
+every interval, so that an interrupted run can be resumed without searching again from the start (see checkpoint_save).
+The first num_pending slots hold the starting points left in progress by the run which is resumed, which the workers take up
+before claiming new ones, and each worker has a slot of its own after them for the starting points which it claims. */
+struct checkpoint_t
+{
+	const char *file_name;
+	long interval; // seconds between checkpoints
+	struct thread_data_t *data;
+	struct checkpoint_slot_t **slots;
+	long num_slots;
+	long num_pending;
+	atomic_long next_pending; // index of the next pending slot to be taken up by a worker
+	atomic_long next_own; // number of workers which have claimed a slot of their own
+	long bytes, written, next_start_index; // where the resumed run stopped (see checkpoint_load)
+	struct checkpoint_record_t *records; // copy of the slots which are active, made by checkpoint_save
+	sem_t finished; // posted when the workers are done
+	pthread_t thread;
+};
+
+enum checkpoint_constants {CHECKPOINT_VERSION = 1};
+
+/* This function initializes a checkpointer for a checkpoint file, without any slots. */
+static void
+checkpoint_init (struct checkpoint_t *checkpoint, const char *file_name, long interval)
+{
+	checkpoint->file_name = file_name;
+	checkpoint->interval = interval;
+	checkpoint->data = NULL;
+	checkpoint->slots = NULL;
+	checkpoint->records = NULL;
+	checkpoint->num_slots = checkpoint->num_pending = 0;
+	checkpoint->bytes = checkpoint->written = checkpoint->next_start_index = 0;
+}
+
+/* This function adds an inactive slot to a checkpointer and returns it. Slots are only added before the checkpointer is started. */
+static struct checkpoint_slot_t *
+checkpoint_add_slot (struct checkpoint_t *checkpoint)
+{
+	struct checkpoint_slot_t **slots = realloc (checkpoint->slots, (checkpoint->num_slots + 1) * sizeof (struct checkpoint_slot_t *));
+	void *memory;
+	if (!slots || posix_memalign (&memory, CACHE_LINE_SIZE, sizeof (struct checkpoint_slot_t)))
+	{
+		fprintf (stderr, "Error: unable to allocate memory for the checkpoint.\n");
+		exit (EXIT_FAILURE);
+	}
+	checkpoint->slots = slots;
+	struct checkpoint_slot_t *slot = slots[checkpoint->num_slots++] = memory;
+	slot->active = FALSE;
+	slot->start_index = slot->found = slot->search = 0;
+	mpz_init (slot->position);
+	atomic_init (&slot->passed, 0);
+	return slot;
+}
+
+/* This function reads the checkpoint file of a run to be resumed. The run must have had the same parameters, except for
+the seed, which is taken from the checkpoint, and the starting points which it left in progress become pending slots. */
+static void
+checkpoint_load (struct checkpoint_t *checkpoint, uint64_t *seed, long num_digits, long num_bits, long per_start, long num_primes,
+	enum boolean safe, enum output_format format)
+{
+	FILE *file = fopen (checkpoint->file_name, "r");
+	if (!file)
+	{
+		fprintf (stderr, "Error: unable to open checkpoint file %s.\n", checkpoint->file_name);
+		exit (EXIT_FAILURE);
+	}
+	int version, saved_safe, saved_format;
+	unsigned long long saved_seed;
+	long saved_digits, saved_bits, saved_per_start, saved_num_primes;
+	if (fscanf (file, "mrprimes checkpoint %d run %llu %ld %ld %ld %ld %d %d output %ld %ld next %ld", &version, &saved_seed, &saved_digits,
+		&saved_bits, &saved_per_start, &saved_num_primes, &saved_safe, &saved_format, &checkpoint->bytes, &checkpoint->written,
+		&checkpoint->next_start_index) != 11 || version != CHECKPOINT_VERSION)
+	{
+		fprintf (stderr, "Error: %s is not a valid checkpoint file.\n", checkpoint->file_name);
+		exit (EXIT_FAILURE);
+	}
+	if (saved_digits != num_digits || saved_bits != num_bits || saved_per_start != per_start || saved_num_primes != num_primes
+		|| saved_safe != (int)safe || saved_format != (int)format)
+	{
+		fprintf (stderr, "Error: checkpoint file %s was written by a run with other options.\n", checkpoint->file_name);
+		exit (EXIT_FAILURE);
+	}
+	*seed = saved_seed;
+	
+	long start_index, found, search;
+	while (fscanf (file, " start %ld %ld %ld", &start_index, &found, &search) == 3)
+	{
+		struct checkpoint_slot_t *slot = checkpoint_add_slot (checkpoint);
+		if (!mpz_inp_str (slot->position, file, 16))
+		{
+			fprintf (stderr, "Error: %s is not a valid checkpoint file.\n", checkpoint->file_name);
+			exit (EXIT_FAILURE);
+		}
+		slot->active = TRUE;
+		slot->start_index = start_index;
+		slot->found = found;
+		slot->search = search;
+	}
+	if (!feof (file))
+	{
+		fprintf (stderr, "Error: %s is not a valid checkpoint file.\n", checkpoint->file_name);
+		exit (EXIT_FAILURE);
+	}
+	fclose (file);
+	checkpoint->num_pending = checkpoint->num_slots;
+}
+
+/* This function saves the state of the search to the checkpoint file. Every slot is locked, so that no prime is reported
+and no starting point is claimed meanwhile, while the next starting point and the state of every starting point in progress
+are copied, and a mark is pushed onto the writer's queue behind the primes reported so far. Once the locks are released, the
+writer reaches the mark and records the size of the output file and the number of primes written at that point, and these
+are saved along with the copy. The output file is synced before the checkpoint file replaces the previous one, so that the
+checkpoint never refers to output which was lost. The checkpoint is written to a temporary file which is then renamed, so that
+an interruption while writing it leaves the previous checkpoint. */
+static void
+checkpoint_save (struct checkpoint_t *checkpoint)
+{
+	struct thread_data_t *data = checkpoint->data;
+	struct writer_t *writer = data->writer;
+	long num_records = 0;
+	
+	for (long i = 0; i < checkpoint->num_slots; ++i)
+		pthread_mutex_lock (&checkpoint->slots[i]->lock);
+	writer_push (writer, &writer->mark);
+	const long next_start_index = atomic_load (&data->next_start_index);
+	for (long i = 0; i < checkpoint->num_slots; ++i)
+	{
+		const struct checkpoint_slot_t *slot = checkpoint->slots[i];
+		if (!slot->active)
+			continue;
+		struct checkpoint_record_t *record = &checkpoint->records[num_records++];
+		record->start_index = slot->start_index;
+		record->found = slot->found;
+		record->search = slot->search;
+		mpz_set (record->position, slot->position);
+		if (mpz_sgn (record->position))
+			mpz_add_ui (record->position, record->position, 2 * (unsigned long)atomic_load_explicit (&slot->passed, memory_order_relaxed));
+	}
+	for (long i = 0; i < checkpoint->num_slots; ++i)
+		pthread_mutex_unlock (&checkpoint->slots[i]->lock);
+	while (sem_wait (&writer->marked))
+		continue; // interrupted by a signal
+	
+	char temp_name[4096];
+	snprintf (temp_name, sizeof (temp_name), "%s.tmp", checkpoint->file_name);
+	FILE *file = fopen (temp_name, "w");
+	if (!file)
+	{
+		fprintf (stderr, "Error: failure to write checkpoint file.\n");
+		exit (EXIT_FAILURE);
+	}
+	fprintf (file, "mrprimes checkpoint %d\nrun %llu %ld %ld %ld %ld %d %d\noutput %ld %ld\nnext %ld\n", CHECKPOINT_VERSION,
+		(unsigned long long)data->seed, data->num_digits, data->num_bits, data->per_start, data->num_primes, (int)data->safe,
+		(int)data->format, writer->mark_bytes, writer->mark_written, next_start_index);
+	for (long i = 0; i < num_records; ++i)
+	{
+		const struct checkpoint_record_t *record = &checkpoint->records[i];
+		fprintf (file, "start %ld %ld %ld ", record->start_index, record->found, record->search);
+		mpz_out_str (file, 16, record->position);
+		fputc ('\n', file);
+	}
+	
+	if ((fsync (fileno (writer->out_file)) && errno != EINVAL) || fflush (file) || fsync (fileno (file)) || fclose (file)
+		|| rename (temp_name, checkpoint->file_name))
+	{
+		fprintf (stderr, "Error: failure to write checkpoint file.\n");
+		exit (EXIT_FAILURE);
+	}
+}
+
+/* This method defines the behavior of the checkpointer: every interval, save the state of the search. */
+static void *
+save_checkpoints (void *checkpoint_args)
+{
+	struct checkpoint_t *checkpoint = (struct checkpoint_t *)checkpoint_args;
+	struct timespec deadline;
+	clock_gettime (CLOCK_REALTIME, &deadline);
+	
+	for (;;)
+	{
+		/* Wait for the interval to pass, or return once the workers are done. */
+		deadline.tv_sec += checkpoint->interval;
+		int timed_out;
+		while ((timed_out = sem_timedwait (&checkpoint->finished, &deadline)) && errno == EINTR)
+			continue;
+		if (!timed_out)
+			return NULL;
+		checkpoint_save (checkpoint);
+	}
+}
+
+/* This function gives a checkpointer a slot for each of the workers searching for the primes of data, and starts it. */
+static void
+checkpoint_start (struct checkpoint_t *checkpoint, struct thread_data_t *data, long num_workers)
+{
+	checkpoint->data = data;
+	for (long i = 0; i < num_workers; ++i)
+		checkpoint_add_slot (checkpoint);
+	checkpoint->records = malloc (checkpoint->num_slots * sizeof (struct checkpoint_record_t));
+	if (!checkpoint->records)
+	{
+		fprintf (stderr, "Error: unable to allocate memory for the checkpoint.\n");
+		exit (EXIT_FAILURE);
+	}
+	for (long i = 0; i < checkpoint->num_slots; ++i)
+	{
+		pthread_mutex_init (&checkpoint->slots[i]->lock, NULL);
+		mpz_init (checkpoint->records[i].position);
+	}
+	atomic_init (&checkpoint->next_pending, 0);
+	atomic_init (&checkpoint->next_own, 0);
+	data->checkpoint = checkpoint;
+	sem_init (&checkpoint->finished, 0, 0);
+	int return_code = pthread_create (&checkpoint->thread, NULL, save_checkpoints, (void *)checkpoint);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+}
+
+/* This function stops the checkpointer once the workers are done. A run which stopped early saves a last checkpoint to be
+resumed from, and the checkpoint file of a run which found all of its primes is removed. */
+static void
+checkpoint_finish (struct checkpoint_t *checkpoint, enum boolean stopped)
+{
+	sem_post (&checkpoint->finished);
+	int return_code = pthread_join (checkpoint->thread, NULL);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+	sem_destroy (&checkpoint->finished);
+	if (stopped)
+		checkpoint_save (checkpoint);
+	else
+		remove (checkpoint->file_name);
+	for (long i = 0; i < checkpoint->num_slots; ++i)
+	{
+		pthread_mutex_destroy (&checkpoint->slots[i]->lock);
+		mpz_clear (checkpoint->slots[i]->position);
+		mpz_clear (checkpoint->records[i].position);
+		free (checkpoint->slots[i]);
+	}
+	free (checkpoint->slots);
+	free (checkpoint->records);
+	checkpoint->data->checkpoint = NULL;
+}
+
+/* This function moves a worker on to its next starting point, and returns FALSE once all of the primes have been claimed.
+The index of the starting point, the number of primes already found from it and the number of searches from it are returned,
+along with the position from which to continue, which is 0 for a starting point which has not been started. When checkpointing,
+the worker first marks the starting point in its slot as done, if it has one, and then takes up a pending starting point of the
+resumed run, or else claims a new one in its own slot, numbered own among the slots of the workers. */
+static enum boolean
+next_start (struct thread_data_t *data, struct checkpoint_slot_t **slot, long own, long *start_index, long *found, long *search, mpz_t position)
+{
+	struct checkpoint_t *checkpoint = data->checkpoint;
+	if (!checkpoint)
+	{
+		*start_index = atomic_fetch_add (&data->next_start_index, 1);
+		*found = *search = 0;
+		mpz_set_ui (position, 0);
+		return *start_index * data->per_start < data->num_primes;
+	}
+	if (*slot)
+	{
+		pthread_mutex_lock (&(*slot)->lock);
+		(*slot)->active = FALSE;
+		pthread_mutex_unlock (&(*slot)->lock);
+	}
+	const long pending = atomic_fetch_add (&checkpoint->next_pending, 1);
+	*slot = checkpoint->slots[pending < checkpoint->num_pending ? pending : checkpoint->num_pending + own];
+	pthread_mutex_lock (&(*slot)->lock);
+	if (pending >= checkpoint->num_pending)
+	{
+		(*slot)->start_index = atomic_fetch_add (&data->next_start_index, 1);
+		(*slot)->found = (*slot)->search = 0;
+		mpz_set_ui ((*slot)->position, 0);
+		atomic_store_explicit (&(*slot)->passed, 0, memory_order_relaxed);
+		(*slot)->active = (*slot)->start_index * data->per_start < data->num_primes;
+	}
+	*start_index = (*slot)->start_index;
+	*found = (*slot)->found;
+	*search = (*slot)->search;
+	mpz_set (position, (*slot)->position);
+	const enum boolean active = (*slot)->active;
+	pthread_mutex_unlock (&(*slot)->lock);
+	return active;
+}
+
+/* This function formats a prime as a result for the writer. Decimal and hexadecimal results are written one per
+line, and binary results are the same as written by mpz_out_raw: the number of bytes of the prime as a 4 byte
+big-endian integer, followed by the bytes of the prime from most to least significant. Hexadecimal and binary
+results skip the base conversion of decimal results, which takes more than linear time in the size of the prime. */
+static struct result_t *
+format_result (const mpz_t n, long index, enum output_format format)
+{
+	const size_t max_length = format == FORMAT_BINARY ? (mpz_sizeinbase (n, 2) + 7) / 8 + 4 : mpz_sizeinbase (n, format == FORMAT_HEX ? 16 : BASE) + 2;
+	struct result_t *result = malloc (sizeof (struct result_t) + max_length);
+	if (!result)
+	{
+		fprintf (stderr, "Error: failure to allocate result.\n");
+		exit (EXIT_FAILURE);
+	}
+	if (format == FORMAT_BINARY)
+	{
+		size_t num_bytes;
+		mpz_export (result->text + 4, &num_bytes, 1, 1, 1, 0, n);
+		for (int i = 0; i < 4; ++i)
+			result->text[i] = (char)(num_bytes >> (24 - 8 * i));
+		result->length = num_bytes + 4;
+	}
+	else
+	{
+		mpz_get_str (result->text, format == FORMAT_HEX ? 16 : BASE, n);
+		result->length = strlen (result->text);
+		result->text[result->length++] = '\n';
+	}
+	result->index = index;
+	return result;
+}
+
+/* The following structure contains the state of one worker: the sieve and the temporaries are allocated once per worker
+and reused for every prime that the worker finds. The random state is reseeded for each starting point, so no other worker ever touches it. */
+struct worker_t
+{
+	mpz_t test_value;
+	gmp_randstate_t random;
+	struct sieve_t sieve;
+	struct scratch_t scratch;
+};
+
+/* This function allocates the state of a worker searching with a table for primes, or safe primes if safe is set, of at most max_bits bits. */
+static void
+worker_init (struct worker_t *worker, const struct offset_table_t *table, mp_bitcnt_t max_bits, enum boolean safe)
+{
+	mpz_init2 (worker->test_value, max_bits);
+	gmp_randinit_mt (worker->random);
+	sieve_init (&worker->sieve, table, max_bits, safe);
+	scratch_init (&worker->scratch, max_bits);
+}
+
+/* This function frees the state of a worker. */
+static void
+worker_clear (struct worker_t *worker)
+{
+	sieve_clear (&worker->sieve);
+	scratch_clear (&worker->scratch);
+	gmp_randclear (worker->random);
+	mpz_clear (worker->test_value);
+}
+
+/* This function generates a random starting point for the search in n from the set of odd integers with the specified
+number of digits or bits. When searching for safe primes p = 2q + 1, the sieve runs over the odd integers q from (p - 1) / 2
+rounded up to odd, so that p runs over the integers 3 mod 4 from the starting point. */
+static void
+gen_search_start (const struct thread_data_t *data, mpz_t n, gmp_randstate_t random)
+{
+	if (data->num_bits)
+		gen_start_bits (n, data->num_bits, random);
+	else
+		gen_start (n, data->start_low, data->start_range, random);
+	if (data->safe)
+	{
+		mpz_tdiv_q_2exp (n, n, 1);
+		mpz_setbit (n, 0);
+	}
+}
+
+/* This function tests the candidate in the test value of a worker. When searching for safe primes, the candidate is q,
+and since safe primes are so rare, p = 2q + 1 is only tested once q passes, and is left in the test value. If the
+candidate budget is used up, the search is stopped instead. */
+static enum boolean
+test_candidate (struct thread_data_t *data, struct worker_t *worker, struct thread_timer_t *stats)
+{
+	mpz_ptr test_value = worker->test_value;
+	if (data->max_candidates && atomic_fetch_add_explicit (&data->num_candidates, 1, memory_order_relaxed) >= data->max_candidates)
+	{
+		stop_search (data->stop, STOP_BUDGET);
+		return FALSE;
+	}
+	enum boolean probably_prime = probable_prime (test_value, data->test, data->precision, data->prefilter, worker->random,
+		&worker->scratch) == VERDICT_PROBABLE_PRIME;
+	if (probably_prime && data->safe)
+	{
+		mpz_mul_2exp (test_value, test_value, 1);
+		mpz_add_ui (test_value, test_value, 1);
+		probably_prime = probable_prime (test_value, data->test, data->precision, data->prefilter, worker->random,
+			&worker->scratch) == VERDICT_PROBABLE_PRIME;
+		if (stats)
+			timer_count (stats, COUNT_TESTS, 1);
+	}
+	if (stats)
+	{
+		timer_lap (stats, STAGE_MILLER_RABIN);
+		timer_count (stats, COUNT_TESTS, 1);
+		if (!probably_prime)
+			timer_count (stats, COUNT_REJECTED, 1);
+	}
+	return probably_prime;
+}
+
+/* This function prints the current number of primes found and hands a prime with its index to the writer or the callback. */
+static void
+report_prime (struct thread_data_t *data, const mpz_t prime, long index, struct thread_timer_t *stats)
+{
+	const long num_found = atomic_fetch_add (&data->current_num_primes, 1) + 1;
+	if (!data->quiet)
+		fprintf (data->status_out, "Prime #%ld found\n", num_found);
+	
+	if (data->writer)
+		writer_submit (data->writer, format_result (prime, index, data->format));
+	else if (data->found)
+		data->found (prime, index, data->found_arg);
+	if (stats)
+		timer_count (stats, COUNT_PRIMES, 1);
+}
+
+/* This function claims starting points from the shared counter until all primes have been claimed,
+and finds the primes from each starting point and hands them to the writer or the callback. When checkpointing,
+the worker records its progress in its checkpoint slot after every candidate (see checkpoint_slot_t), and own numbers its slot. */
+static void
+search (struct thread_data_t *data, struct worker_t *worker, long own)
+{
+	mpz_ptr test_value = worker->test_value;
+	struct sieve_t *sieve = &worker->sieve;
+	struct checkpoint_slot_t *slot = NULL;
+	long start_index, found, num_searches;
+	long base_sieved = 0; // odd integers the sieve had passed at the position of the slot
+	struct thread_timer_t *stats = data->timers ? timer_claim (data->timers) : NULL;
+	enum boolean probably_prime;
+	worker->scratch.stop = data->stop;
+	worker->scratch.stream_pending = FALSE; // the stream of each starting point is seeded at once
+	
+	/* Each starting point yields the next per_start primes, which are given consecutive prime indices. */
+	while (!atomic_load_explicit (data->stop, memory_order_relaxed)
+		&& next_start (data, &slot, own, &start_index, &found, &num_searches, test_value))
+	{
+		const long first_index = start_index * data->per_start;
+		const long count = data->num_primes - first_index < data->per_start ? data->num_primes - first_index : data->per_start;
+		
+		/* A starting point left in progress by a resumed run continues from its saved position. The stream of the starting
+		point cannot be restored to where it was, so the rest of the search draws from a stream of its own instead. */
+		enum boolean started = mpz_sgn (test_value) != 0;
+		if (started)
+		{
+			seed_chunk_stream (worker->random, data->seed, data->first_stream + start_index, UINT64_MAX - found, worker->scratch.stream_seed);
+			sieve_start (sieve, test_value);
+			base_sieved = sieve->sieved;
+		}
+		else
+			seed_stream (worker->random, data->seed, data->first_stream + start_index, worker->scratch.stream_seed);
+		
+		while (found < count)
+		{
+			if (stats)
+				timer_start (stats);
+			if (!started)
+			{
+				gen_search_start (data, test_value, worker->random);
+				if (stats)
+					timer_lap (stats, STAGE_GEN_START);
+				
+				/* Keeping track of the offsets from odd integers divisible by low prime numbers allows for sieving out
+				odd numbers divisible by these low primes without testing them.  See readme for explanation of this principle. */
+				sieve_start (sieve, test_value);
+				started = TRUE;
+				if (slot)
+				{
+					pthread_mutex_lock (&slot->lock);
+					mpz_set (slot->position, test_value);
+					atomic_store_explicit (&slot->passed, 0, memory_order_relaxed);
+					pthread_mutex_unlock (&slot->lock);
+					base_sieved = sieve->sieved;
+				}
+				if (stats)
+					timer_lap (stats, STAGE_OFFSET_INIT);
+			}
+			
+			/* After a prime is found, the search for the next one continues from the same sieve. */
+			do
+			{
+				next_test (test_value, sieve);
+				if (stats)
+				{
+					timer_lap (stats, STAGE_NEXT_TEST);
+					timer_set_count (stats, COUNT_SIEVED, sieve->sieved);
+				}
+				probably_prime = test_candidate (data, worker, stats);
+				if (slot && !probably_prime && !atomic_load_explicit (data->stop, memory_order_relaxed))
+					atomic_store_explicit (&slot->passed, sieve->sieved - base_sieved, memory_order_relaxed);
+			}
+			while (!probably_prime && !atomic_load_explicit (data->stop, memory_order_relaxed));
+			if (!probably_prime)
+				return;
+			
+			/* In the rare case that the search from a starting point with the specified number of bits runs past the
+			largest integer with that number of bits, the search is started over from another starting point. */
+			if (data->num_bits && (long)mpz_sizeinbase (test_value, 2) > data->num_bits)
+			{
+				started = FALSE;
+				continue;
+			}
+			
+			if (slot)
+				pthread_mutex_lock (&slot->lock);
+			report_prime (data, test_value, first_index + found, stats);
+			++found;
+			if (slot)
+			{
+				slot->found = found;
+				mpz_add_ui (slot->position, sieve->window_start, 2 * sieve->position);
+				atomic_store_explicit (&slot->passed, 0, memory_order_relaxed);
+				pthread_mutex_unlock (&slot->lock);
+				base_sieved = sieve->sieved;
+			}
+		}
+	}
+}
+
+/* When there are fewer starting points than workers, and the primes have at least COOPERATIVE_MIN_BITS bits, the workers
+cooperate on the search from each starting point instead, in chunks of COOPERATIVE_CHUNK odd integers (see cooperate).
+Below that size, a prime takes too little time to be worth the two barriers between searches. */
+enum cooperation_constants {COOPERATIVE_CHUNK = 256, COOPERATIVE_MIN_BITS = 512};
+
+/* The following structure contains the state shared by the workers when they cooperate on the search from each starting
+point. Each search is for the first prime from a point: the workers claim chunks of the odd integers from it in increasing
+order, and record the lowest index of a candidate which passed the test. A worker stops once its candidates are past the
+lowest hit, and since every chunk below the hit has already been claimed, the search ends with the lowest hit once all of
+them are done, which is the prime a single worker would have found. Between searches, one worker reports the prime and
+sets up the next search while the others wait at the barrier. The counters which every worker updates have cache lines of their own. */
+struct cooperation_t
+{
+	pthread_barrier_t barrier;
+	mpz_t start; // first odd integer of the current search
+	_Alignas (CACHE_LINE_SIZE) atomic_long next_chunk; // index of the next chunk of the current search to be claimed
+	_Alignas (CACHE_LINE_SIZE) atomic_long best; // lowest index of a hit in the current search, or LONG_MAX
+	_Alignas (CACHE_LINE_SIZE) gmp_randstate_t random; // stream of the current starting point, only used to generate starting points
+	long start_index; // index of the current starting point, or -1 before the first search
+	long found; // number of primes found from the current starting point
+	long search; // number of searches from the current starting point, which tells apart the streams of their chunks
+	struct checkpoint_slot_t *slot; // checkpoint slot of the current starting point, or NULL
+	enum boolean finished;
+};
+
+/* This function is performed by one of the cooperating workers between two searches: it reports the prime found by the
+search which just ended, if any, and sets up the next search, or sets finished when there are no more primes to find. */
+static void
+cooperation_setup (struct thread_data_t *data, struct worker_t *worker, struct thread_timer_t *stats)
+{
+	struct cooperation_t *shared = data->cooperation;
+	mpz_ptr test_value = worker->test_value;
+	enum boolean restart = FALSE;
+	if (atomic_load (data->stop))
+	{
+		shared->finished = TRUE;
+		return;
+	}
+	
+	/* The next search from the same starting point continues after the candidate which was hit. As in search,
+	a search which runs past the largest integer with the specified number of bits starts over from another point. */
+	if (shared->start_index >= 0)
+	{
+		mpz_add_ui (test_value, shared->start, 2 * (unsigned long)atomic_load (&shared->best));
+		mpz_add_ui (shared->start, test_value, 2);
+		if (data->safe)
+		{
+			mpz_mul_2exp (test_value, test_value, 1);
+			mpz_add_ui (test_value, test_value, 1);
+		}
+		if (data->num_bits && (long)mpz_sizeinbase (test_value, 2) > data->num_bits)
+			restart = TRUE;
+		else
+		{
+			if (shared->slot)
+				pthread_mutex_lock (&shared->slot->lock);
+			report_prime (data, test_value, shared->start_index * data->per_start + shared->found++, stats);
+			if (shared->slot)
+			{
+				shared->slot->found = shared->found;
+				shared->slot->search = shared->search;
+				mpz_set (shared->slot->position, shared->start);
+				pthread_mutex_unlock (&shared->slot->lock);
+			}
+		}
+	}
+	
+	/* Claim the next starting point once all of the primes from the current one have been found. A starting point left in
+	progress by a resumed run continues with the search after the last one which found a prime, as in search. */
+	if (shared->start_index < 0 || shared->found == data->per_start || shared->start_index * data->per_start + shared->found == data->num_primes)
+	{
+		if (!next_start (data, &shared->slot, 0, &shared->start_index, &shared->found, &shared->search, shared->start))
+		{
+			shared->finished = TRUE;
+			return;
+		}
+		restart = !mpz_sgn (shared->start);
+		if (restart)
+			seed_stream (shared->random, data->seed, data->first_stream + shared->start_index, worker->scratch.stream_seed);
+		else
+			seed_chunk_stream (shared->random, data->seed, data->first_stream + shared->start_index, UINT64_MAX - shared->found,
+				worker->scratch.stream_seed);
+	}
+	if (restart)
+	{
+		if (stats)
+			timer_start (stats);
+		gen_search_start (data, shared->start, shared->random);
+		if (stats)
+			timer_lap (stats, STAGE_GEN_START);
+	}
+	++shared->search;
+	atomic_store (&shared->next_chunk, 0);
+	atomic_store (&shared->best, LONG_MAX);
+}
+
+/* This function lets a worker cooperate with the others on the search from each starting point until all primes have been
+found. Each worker sieves the windows of the chunks it claims, moving its own sieve forward or computing its offsets for the
+window afresh, and draws the random numbers for the candidates of each chunk from a stream of their own, determined by the
+seed, the starting point, the search and the chunk, so that the primes found do not depend on which worker claims which chunk.
+Seeding a stream takes as long as several tests, so the stream of a chunk is only seeded once a test draws from it, which with
+the base 2 round only happens for the candidates which pass that round. */
+static void
+cooperate (struct thread_data_t *data, struct worker_t *worker)
+{
+	struct cooperation_t *shared = data->cooperation;
+	struct sieve_t *sieve = &worker->sieve;
+	struct thread_timer_t *stats = data->timers ? timer_claim (data->timers) : NULL;
+	const long window = data->table->window;
+	const long chunks_per_window = (window + COOPERATIVE_CHUNK - 1) / COOPERATIVE_CHUNK;
+	worker->scratch.stop = data->stop;
+	
+	for (;;)
+	{
+		if (pthread_barrier_wait (&shared->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+			cooperation_setup (data, worker, stats);
+		pthread_barrier_wait (&shared->barrier);
+		if (shared->finished)
+			return;
+		
+		long window_number = -1; // window of the current search which the sieve holds
+		while (!atomic_load_explicit (data->stop, memory_order_relaxed))
+		{
+			const long chunk = atomic_fetch_add (&shared->next_chunk, 1);
+			const long target = chunk / chunks_per_window;
+			const long first = chunk % chunks_per_window * COOPERATIVE_CHUNK;
+			const long end = first + COOPERATIVE_CHUNK < window ? first + COOPERATIVE_CHUNK : window;
+			if (target * window + first > atomic_load (&shared->best))
+				break;
+			if (stats)
+				timer_start (stats);
+			if (target != window_number)
+			{
+				sieve_seek (sieve, shared->start, window_number, target);
+				window_number = target;
+			}
+			worker->scratch.stream_pending = TRUE;
+			worker->scratch.pending_seed = data->seed;
+			worker->scratch.pending_index = data->first_stream + shared->start_index;
+			worker->scratch.pending_chunk = (uint64_t)shared->search << 40 | chunk;
+			sieve->sieved += end - first;
+			if (stats)
+			{
+				timer_lap (stats, STAGE_NEXT_TEST);
+				timer_set_count (stats, COUNT_SIEVED, sieve->sieved);
+			}
+			
+			for (long j = first; j < end && !atomic_load_explicit (data->stop, memory_order_relaxed); ++j)
+			{
+				if (sieve->bits[j / 64] >> (j % 64) & 1)
+					continue;
+				const long index = target * window + j;
+				if (index > atomic_load_explicit (&shared->best, memory_order_relaxed))
+					break;
+				mpz_add_ui (worker->test_value, sieve->window_start, 2 * j);
+				if (test_candidate (data, worker, stats))
+				{
+					long best = atomic_load (&shared->best);
+					while (index < best && !atomic_compare_exchange_weak (&shared->best, &best, index))
+						continue;
+					break;
+				}
+			}
+		}
+	}
+}
+
+#ifdef __linux__
+/* The following structure contains the placement of the workers on the processors (--affinity): the workers are pinned to
+the processors of cpus in turn, and when these span more than one NUMA node, the workers of each node share a copy of the
+offset table in the memory of that node, which is made by the first of them to run. Without pinning, a worker could run on
+any node, so there is no telling which node its table should be on. */
+struct placement_t
+{
+	int *cpus;
+	long num_cpus;
+	int *nodes; // NUMA node of each processor of cpus
+	long num_nodes; // one more than the highest node
+	enum boolean replicate; // whether the processors span more than one node
+	const struct offset_table_t *table;
+	struct offset_table_t **copies; // copy of the table for each node, or NULL until a worker on the node makes it
+	pthread_mutex_t lock; // held while a copy is made
+	atomic_long next_worker; // number of workers which have been pinned
+};
+
+/* This function parses a list of processors such as 0-3,8,10-11 into a set, and returns whether the list is valid. */
+static enum boolean
+parse_cpu_list (const char *list, cpu_set_t *set)
+{
+	CPU_ZERO (set);
+	for (const char *item = list; *item && *item != '\n'; ++item)
+	{
+		char *end;
+		const long first = strtol (item, &end, BASE);
+		long last = first;
+		if (end == item || first < 0 || first >= CPU_SETSIZE)
+			return FALSE;
+		if (*end == '-')
+		{
+			item = end + 1;
+			last = strtol (item, &end, BASE);
+			if (end == item || last < first || last >= CPU_SETSIZE)
+				return FALSE;
+		}
+		for (long cpu = first; cpu <= last; ++cpu)
+			CPU_SET (cpu, set);
+		item = end;
+		if (*item != ',')
+			break;
+	}
+	return TRUE;
+}
+
+/* This function finds the NUMA node of every processor from the node directories of sysfs, and returns one more than the
+highest node. Processors for which no node is listed, such as all of them on a machine without NUMA, are put on node 0. */
+static long
+read_cpu_nodes (int node_of[CPU_SETSIZE])
+{
+	long num_nodes = 1;
+	memset (node_of, 0, CPU_SETSIZE * sizeof (int));
+	DIR *directory = opendir ("/sys/devices/system/node");
+	if (!directory)
+		return num_nodes;
+	struct dirent *entry;
+	while ((entry = readdir (directory)))
+	{
+		int node;
+		char path[300], list[4096];
+		if (sscanf (entry->d_name, "node%d", &node) != 1 || node < 0)
+			continue;
+		snprintf (path, sizeof (path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+		FILE *file = fopen (path, "r");
+		if (!file)
+			continue;
+		cpu_set_t cpus;
+		if (fgets (list, sizeof (list), file) && parse_cpu_list (list, &cpus))
+		{
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+				if (CPU_ISSET (cpu, &cpus))
+					node_of[cpu] = node;
+			if (node >= num_nodes)
+				num_nodes = node + 1;
+		}
+		fclose (file);
+	}
+	closedir (directory);
+	return num_nodes;
+}
+
+/* This function sets up the placement of the workers for an --affinity mode, and returns FALSE if the mode is invalid or
+leaves no processor to run on. In compact mode, the workers are pinned to the processors which the program may run on in
+order, which fills up one node before the next. In scatter mode, they are pinned to the processors of each node in turn,
+which spreads them over the nodes. Otherwise the mode is a list of processors, which are used in the order of their numbers. */
+static enum boolean
+placement_init (struct placement_t *placement, const char *mode, const struct offset_table_t *table)
+{
+	cpu_set_t allowed, chosen;
+	if (sched_getaffinity (0, sizeof (allowed), &allowed))
+		return FALSE;
+	if (strcmp (mode, "compact") == 0 || strcmp (mode, "scatter") == 0)
+		chosen = allowed;
+	else if (!parse_cpu_list (mode, &chosen))
+		return FALSE;
+	CPU_AND (&chosen, &chosen, &allowed);
+	placement->num_cpus = CPU_COUNT (&chosen);
+	if (!placement->num_cpus)
+		return FALSE;
+	
+	int node_of[CPU_SETSIZE];
+	placement->num_nodes = read_cpu_nodes (node_of);
+	placement->cpus = malloc (placement->num_cpus * sizeof (int));
+	placement->nodes = malloc (placement->num_cpus * sizeof (int));
+	placement->copies = calloc (placement->num_nodes, sizeof (struct offset_table_t *));
+	if (!placement->cpus || !placement->nodes || !placement->copies)
+	{
+		fprintf (stderr, "Error: unable to allocate memory for the placement of the workers.\n");
+		exit (EXIT_FAILURE);
+	}
+	
+	/* Scatter mode takes the processors in rounds, with the next processor of every node in each round. */
+	const enum boolean scatter = strcmp (mode, "scatter") == 0;
+	long count = 0;
+	for (long round = 0; count < placement->num_cpus; ++round)
+	{
+		for (long node = 0; node < (scatter ? placement->num_nodes : 1); ++node)
+		{
+			long rank = 0;
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+			{
+				if (!CPU_ISSET (cpu, &chosen) || (scatter && node_of[cpu] != node))
+					continue;
+				if (scatter ? rank++ == round : !round)
+					placement->cpus[count++] = cpu;
+			}
+		}
+	}
+	placement->replicate = FALSE;
+	for (long i = 0; i < placement->num_cpus; ++i)
+	{
+		placement->nodes[i] = node_of[placement->cpus[i]];
+		if (placement->nodes[i] != placement->nodes[0])
+			placement->replicate = TRUE;
+	}
+	placement->table = table;
+	pthread_mutex_init (&placement->lock, NULL);
+	atomic_init (&placement->next_worker, 0);
+	return TRUE;
+}
+
+/* This function pins the calling worker to its processor, and returns the table which the worker should use: the copy of its
+node, which it makes if it is the first worker there, or the shared table if the workers are all on the same node. */
+static const struct offset_table_t *
+placement_apply (struct placement_t *placement)
+{
+	const long worker = atomic_fetch_add (&placement->next_worker, 1) % placement->num_cpus;
+	cpu_set_t cpu;
+	CPU_ZERO (&cpu);
+	CPU_SET (placement->cpus[worker], &cpu);
+	const int return_code = pthread_setaffinity_np (pthread_self (), sizeof (cpu), &cpu);
+	if (return_code)
+		fprintf (stderr, "Warning: unable to pin a worker to processor %d (return code %d).\n", placement->cpus[worker], return_code);
+	if (!placement->replicate)
+		return placement->table;
+	
+	const int node = placement->nodes[worker];
+	pthread_mutex_lock (&placement->lock);
+	if (!placement->copies[node])
+	{
+		struct offset_table_t *copy = malloc (sizeof (struct offset_table_t));
+		if (!copy)
+		{
+			fprintf (stderr, "Error: failure to allocate table copy.\n");
+			exit (EXIT_FAILURE);
+		}
+		table_copy (copy, placement->table);
+		placement->copies[node] = copy;
+	}
+	pthread_mutex_unlock (&placement->lock);
+	return placement->copies[node];
+}
+
+/* This function frees a placement, along with the copies of the table made by the workers. */
+static void
+placement_free (struct placement_t *placement)
+{
+	for (long node = 0; node < placement->num_nodes; ++node)
+	{
+		if (placement->copies[node])
+		{
+			table_free (placement->copies[node]);
+			free (placement->copies[node]);
+		}
+	}
+	pthread_mutex_destroy (&placement->lock);
+	free (placement->cpus);
+	free (placement->nodes);
+	free (placement->copies);
+}
+#endif
+
+/* This method defines the behavior of each worker thread of the program: search for primes until all of them have been claimed. */
+static void *
+find_prime (void *thread_args)
+{
+	struct thread_data_t *data = (struct thread_data_t *)thread_args;
+	struct worker_t worker;
+	const struct offset_table_t *table = data->table;
+#ifdef __linux__
+	if (data->placement)
+		table = placement_apply (data->placement);
+#endif
+	worker_init (&worker, table, data->max_bits, data->safe);
+	if (data->cooperation)
+		cooperate (data, &worker);
+	else
+		search (data, &worker, data->checkpoint ? atomic_fetch_add (&data->checkpoint->next_own, 1) : 0);
+	worker_clear (&worker);
+	pthread_exit (EXIT_SUCCESS);
+}
+
+/* This function initializes the thread arguments which are not const. The writer is left unset. */
+static void
+thread_args_init (struct thread_data_t *data, const enum boolean prefilter, const long per_start, const long num_bits, const uint64_t seed)
+{
+	data->prefilter = prefilter;
+	data->test = TEST_MILLER_RABIN;
+	data->cooperation = NULL;
+	data->checkpoint = NULL;
+	data->placement = NULL;
+	data->per_start = per_start;
+	atomic_init (&data->next_start_index, 0);
+	atomic_init (&data->current_num_primes, 0);
+	data->writer = NULL;
+	data->format = FORMAT_DECIMAL;
+	data->found = NULL;
+	data->found_arg = NULL;
+	data->seed = seed;
+	data->first_stream = 0;
+	mpz_inits (data->start_low, data->start_range, NULL);
+	init_start_bounds (data->start_low, data->start_range, data->num_digits);
+	data->num_bits = num_bits;
+	if (num_bits)
+		data->max_bits = num_bits + 1;
+	else
+		data->max_bits = mpz_sizeinbase (data->start_low, 2) + 4; // candidates are less than 10 times start_low
+	data->quiet = FALSE;
+	data->status_out = status_out;
+	data->safe = FALSE;
+	data->timers = NULL;
+	data->max_candidates = 0;
+	data->stop = &stop_requested;
+	atomic_init (&data->num_candidates, 0);
+}
+
+/* This function returns the number of workers which run_workers starts for a requested number of threads. If the number
+of processors could not be determined, it falls back to a single worker. When there are fewer starting points than workers,
+the workers cooperate on the search from each starting point in turn if the primes are large enough, and otherwise there
+is no use in having more workers than starting points. */
+static long
+worker_count (const struct thread_data_t *data, long num_threads)
+{
+	const long num_starts = data->num_primes / data->per_start + (data->num_primes % data->per_start != 0);
+	if (num_threads <= 0)
+		num_threads = 1;
+	if (num_threads > num_starts && data->max_bits < COOPERATIVE_MIN_BITS)
+		num_threads = num_starts;
+	return num_threads;
+}
+
+/* This function runs a fixed pool of worker threads which share the work of finding the primes, and
+returns when all of them are done. The number of workers is given by worker_count. */
+static void
+run_workers (struct thread_data_t *data, long num_threads)
+{
+	const long num_starts = data->num_primes / data->per_start + (data->num_primes % data->per_start != 0);
+	num_threads = worker_count (data, num_threads);
+	struct cooperation_t cooperation;
+	if (num_threads > num_starts)
+	{
+		pthread_barrier_init (&cooperation.barrier, NULL, num_threads);
+		mpz_init (cooperation.start);
+		gmp_randinit_mt (cooperation.random);
+		cooperation.start_index = -1;
+		cooperation.slot = NULL;
+		cooperation.finished = FALSE;
+		data->cooperation = &cooperation;
+	}
+	
+	/* Initialize and set thread detached attribute. */
+	pthread_attr_t attr;
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_JOINABLE);
+	
+	pthread_t *threads = malloc (num_threads * sizeof (pthread_t));
+	if (!threads)
+	{
+		fprintf (stderr, "Error: unable to allocate memory for the worker threads.\n");
+		exit (EXIT_FAILURE);
+	}
+	int return_code;
+	for (int i = 0; i < num_threads; ++i)
+	{
+		return_code = pthread_create (&threads[i], &attr, find_prime, (void *)data);
+		if (return_code)
+		{
+			fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+			exit (EXIT_FAILURE);
+		}
+	}
+	
+	/* Free attribute and wait for the threads to finish. */
+	pthread_attr_destroy (&attr);
+	for (int i = 0; i < num_threads; ++i)
+	{
+		return_code = pthread_join (threads[i], NULL);
+		if (return_code)
+		{
+			fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
+			exit (EXIT_FAILURE);
+		}
+	}
+	free (threads);
+	if (data->cooperation)
+	{
+		pthread_barrier_destroy (&cooperation.barrier);
+		mpz_clear (cooperation.start);
+		gmp_randclear (cooperation.random);
+		data->cooperation = NULL;
+	}
+}
+
+/* Candidates are checked in batches of this many, each of which is read, tested and written as a unit. */
+enum check_constants {CHECK_BATCH_SIZE = 256};
+
+/* The following structure contains one batch of candidates in the check mode. The buffers of the candidates are reused
+for every batch which goes through the same slot (see checker_t), so that reading does not allocate once it is warm. */
+struct check_batch_t
+{
+	char *candidates[CHECK_BATCH_SIZE]; // the text of each candidate without its newline, or its bytes in the binary format
+	size_t lengths[CHECK_BATCH_SIZE];
+	size_t sizes[CHECK_BATCH_SIZE]; // allocated size of each candidate buffer
+	long count;
+	enum boolean done; // whether the verdicts are ready to be written
+	struct result_t *result; // the verdicts of the batch, or NULL if the program was stopped before all of them were found
+	long num_primes; // number of verdicts of the batch which are prime
+};
+
+/* The following structure contains the state of the check mode. The reader fills a ring of batch slots in input order
+and posts to filled for each one, and the workers claim the batches in order and test them. Since the workers finish out
+of order, a finished batch waits in its slot until all of the batches before it have been handed to the writer, which
+keeps the verdicts in input order, and the slot is only then posted to free for the reader to fill again. When the program
+is stopped in the middle of a batch, that batch and every one after it are dropped, so that the output ends with the last
+batch whose verdicts were all found instead of giving verdicts for candidates which were not tested to the end. */
+struct checker_t
+{
+	const struct offset_table_t *table;
+	struct writer_t *writer;
+	enum output_format format;
+	int precision;
+	enum boolean prefilter;
+	enum primality_test test;
+	uint64_t seed; // each batch gets the random stream of its index, so the verdicts do not depend on the number of workers
+	struct check_batch_t *slots;
+	long num_slots;
+	sem_t free, filled;
+	atomic_long next_batch; // index of the next batch to be claimed by a worker
+	atomic_long num_batches; // number of batches read, once the reader has reached the end of the input, and LONG_MAX until then
+	pthread_mutex_t commit_lock;
+	long next_commit; // index of the next batch to be handed to the writer, guarded by commit_lock
+	enum boolean truncated; // whether a batch has been dropped, after which no more batches are handed to the writer, guarded by commit_lock
+	long num_checked, num_primes; // numbers of verdicts handed to the writer and of those which are prime, guarded by commit_lock
+};
+
+/* This function reads the next candidate of the input into a buffer which is grown as needed, and returns FALSE at the end
+of the input. Text candidates are lines, with trailing whitespace removed, and binary candidates are records of a 4 byte
+big endian length followed by the bytes of the candidate, as written by -f bin. Blank lines are skipped. */
+static enum boolean
+read_candidate (FILE *in_file, enum output_format format, char **buffer, size_t *size, size_t *length)
+{
+	if (format == FORMAT_BINARY)
+	{
+		unsigned char header[4];
+		if (fread (header, 1, 4, in_file) < 4)
+			return FALSE;
+		*length = (size_t)header[0] << 24 | (size_t)header[1] << 16 | (size_t)header[2] << 8 | header[3];
+		if (*length + 1 > *size)
+		{
+			free (*buffer);
+			*size = *length + 1;
+			if (!(*buffer = malloc (*size)))
+			{
+				fprintf (stderr, "Error: failure to allocate candidate.\n");
+				exit (EXIT_FAILURE);
+			}
+		}
+		return fread (*buffer, 1, *length, in_file) == *length;
+	}
+	for (;;)
+	{
+		ssize_t line_length = getline (buffer, size, in_file);
+		if (line_length < 0)
+			return FALSE;
+		while (line_length > 0 && isspace ((unsigned char)(*buffer)[line_length - 1]))
+			--line_length;
+		(*buffer)[line_length] = '\0';
+		*length = (size_t)line_length;
+		if (line_length)
+			return TRUE;
+	}
+}
+
+/* This method defines the behavior of each worker thread of the check mode: test the batches in the order they were
+read, until the reader has reached the end of the input, and hand the verdicts to the writer in input order. */
+static void *
+check_candidates (void *checker_args)
+{
+	struct checker_t *checker = (struct checker_t *)checker_args;
+	mpz_t n;
+	mpz_init (n);
+	gmp_randstate_t random;
+	gmp_randinit_mt (random);
+	mp_bitcnt_t max_bits = 64;
+	struct scratch_t scratch;
+	scratch_init (&scratch, max_bits);
+	
+	for (;;)
+	{
+		while (sem_wait (&checker->filled))
+			continue;
+		const long index = atomic_fetch_add (&checker->next_batch, 1);
+		if (index >= atomic_load (&checker->num_batches))
+			break;
+		struct check_batch_t *batch = &checker->slots[index % checker->num_slots];
+		seed_stream (random, checker->seed, index, scratch.stream_seed);
+		
+		/* Room for each verdict is the longest candidate as it is printed, a space, the word and a newline. */
+		size_t max_length = 0;
+		for (long i = 0; i < batch->count; ++i)
+			max_length += (checker->format == FORMAT_BINARY ? 8 * batch->lengths[i] * 146 / 485 + 2 : batch->lengths[i]) + 12;
+		struct result_t *result = malloc (sizeof (struct result_t) + max_length);
+		if (!result)
+		{
+			fprintf (stderr, "Error: failure to allocate result.\n");
+			exit (EXIT_FAILURE);
+		}
+		result->index = index;
+		result->length = 0;
+		
+		long num_primes = 0;
+		enum boolean stopped = FALSE;
+		for (long i = 0; i < batch->count; ++i)
+		{
+			const char *verdict = "invalid";
+			if (checker->format == FORMAT_BINARY)
+				mpz_import (n, batch->lengths[i], 1, 1, 1, 0, batch->candidates[i]);
+			if (checker->format == FORMAT_BINARY || !mpz_set_str (n, batch->candidates[i], checker->format == FORMAT_HEX ? 16 : BASE))
+			{
+				if (mpz_sizeinbase (n, 2) + 1 > max_bits)
+				{
+					scratch_clear (&scratch);
+					max_bits = 2 * mpz_sizeinbase (n, 2);
+					scratch_init (&scratch, max_bits);
+				}
+				const enum trial_result trial = trial_division (checker->table, n);
+				const enum verdict outcome = trial != TRIAL_UNDECIDED ? (trial == TRIAL_PRIME ? VERDICT_PROBABLE_PRIME : VERDICT_COMPOSITE) :
+					atomic_load (&stop_requested) ? VERDICT_STOPPED :
+					probable_prime (n, checker->test, checker->precision, checker->prefilter, random, &scratch);
+				if (outcome == VERDICT_STOPPED)
+				{
+					stopped = TRUE;
+					break;
+				}
+				num_primes += outcome == VERDICT_PROBABLE_PRIME;
+				verdict = outcome == VERDICT_PROBABLE_PRIME ? "prime" : "composite";
+			}
+			if (checker->format == FORMAT_BINARY)
+			{
+				mpz_get_str (result->text + result->length, BASE, n);
+				result->length += strlen (result->text + result->length);
+			}
+			else
+			{
+				memcpy (result->text + result->length, batch->candidates[i], batch->lengths[i]);
+				result->length += batch->lengths[i];
+			}
+			result->length += sprintf (result->text + result->length, " %s\n", verdict);
+		}
+		if (stopped)
+		{
+			free (result);
+			result = NULL;
+		}
+		
+		/* Hand this batch, and every finished batch after it, to the writer if it is the next one in input order. The first
+		batch which was stopped, and every batch after it, are dropped instead. */
+		pthread_mutex_lock (&checker->commit_lock);
+		batch->result = result;
+		batch->num_primes = num_primes;
+		batch->done = TRUE;
+		for (batch = &checker->slots[checker->next_commit % checker->num_slots]; batch->done;
+			batch = &checker->slots[checker->next_commit % checker->num_slots])
+		{
+			batch->done = FALSE;
+			if (!batch->result)
+				checker->truncated = TRUE;
+			if (checker->truncated)
+				free (batch->result);
+			else
+			{
+				writer_submit (checker->writer, batch->result);
+				checker->num_checked += batch->count;
+				checker->num_primes += batch->num_primes;
+			}
+			++checker->next_commit;
+			sem_post (&checker->free);
+		}
+		pthread_mutex_unlock (&checker->commit_lock);
+	}
+	
+	scratch_clear (&scratch);
+	gmp_randclear (random);
+	mpz_clear (n);
+	pthread_exit (EXIT_SUCCESS);
+}
+
+/* This function checks the candidates read from a file, or from standard input if the name is "-", and hands a verdict
+for each one to the writer in input order. The reader runs on the calling thread while the workers test the batches
+already read, so reading and testing overlap. */
+static void
+run_check (const char *in_file_name, const struct offset_table_t *table, struct writer_t *writer, const enum output_format format,
+	const int precision, const enum boolean prefilter, const enum primality_test test, const uint64_t seed, long num_threads)
+{
+	FILE *in_file = strcmp (in_file_name, "-") == 0 ? stdin : fopen (in_file_name, format == FORMAT_BINARY ? "rb" : "r");
+	if (!in_file)
+	{
+		fprintf (stderr, "Error: unable to open the file of candidates.\n");
+		exit (EXIT_FAILURE);
+	}
+	if (num_threads <= 0)
+		num_threads = 1;
+	
+	/* Two batches per worker keep every worker busy while the reader fills the next ones. */
+	struct checker_t checker = {table, writer, format, precision, prefilter, test, seed};
+	checker.num_slots = 2 * num_threads + 1;
+	checker.slots = calloc (checker.num_slots, sizeof (struct check_batch_t));
+	pthread_t *threads = malloc (num_threads * sizeof (pthread_t));
+	if (!checker.slots || !threads)
+	{
+		fprintf (stderr, "Error: unable to allocate memory for the check mode.\n");
+		exit (EXIT_FAILURE);
+	}
+	sem_init (&checker.free, 0, checker.num_slots);
+	sem_init (&checker.filled, 0, 0);
+	atomic_init (&checker.next_batch, 0);
+	atomic_init (&checker.num_batches, LONG_MAX);
+	pthread_mutex_init (&checker.commit_lock, NULL);
+	checker.next_commit = 0;
+	checker.truncated = FALSE;
+	checker.num_checked = checker.num_primes = 0;
+	
+	int return_code;
+	for (long i = 0; i < num_threads; ++i)
+	{
+		return_code = pthread_create (&threads[i], NULL, check_candidates, (void *)&checker);
+		if (return_code)
+		{
+			fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+			exit (EXIT_FAILURE);
+		}
+	}
+	
+	/* Read the batches until the end of the input, or until the program is stopped. */
+	long num_batches = 0;
+	for (enum boolean more = TRUE; more && !atomic_load (&stop_requested); ++num_batches)
+	{
+		while (sem_wait (&checker.free))
+			continue;
+		struct check_batch_t *batch = &checker.slots[num_batches % checker.num_slots];
+		for (batch->count = 0; batch->count < CHECK_BATCH_SIZE; ++batch->count)
+		{
+			const long i = batch->count;
+			if (!(more = read_candidate (in_file, format, &batch->candidates[i], &batch->sizes[i], &batch->lengths[i])))
+				break;
+		}
+		if (!batch->count)
+		{
+			sem_post (&checker.free);
+			break;
+		}
+		sem_post (&checker.filled);
+	}
+	if (ferror (in_file))
+	{
+		fprintf (stderr, "Error: failure to read the file of candidates.\n");
+		exit (EXIT_FAILURE);
+	}
+	
+	/* Wake each worker once more to find that there are no batches left. */
+	atomic_store (&checker.num_batches, num_batches);
+	for (long i = 0; i < num_threads; ++i)
+		sem_post (&checker.filled);
+	for (long i = 0; i < num_threads; ++i)
+	{
+		return_code = pthread_join (threads[i], NULL);
+		if (return_code)
+		{
+			fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
+			exit (EXIT_FAILURE);
+		}
+	}
+	fprintf (status_out, "Checked %ld candidates, of which %ld are probable primes.\n", checker.num_checked, checker.num_primes);
+	
+	if (in_file != stdin)
+		fclose (in_file);
+	for (long i = 0; i < checker.num_slots; ++i)
+		for (long j = 0; j < CHECK_BATCH_SIZE; ++j)
+			free (checker.slots[i].candidates[j]);
+	free (checker.slots);
+	free (threads);
+	sem_destroy (&checker.free);
+	sem_destroy (&checker.filled);
+	pthread_mutex_destroy (&checker.commit_lock);
+}
+
+/* In distributed generation, a coordinator hands out shards of consecutive starting points to worker nodes, which connect
+to it over TCP, and writes the primes which they send back to the output file. A worker node searches a shard with the
+random streams of its starting points (see seed_stream), which are derived from the seed of the coordinator, so the primes
+of every shard are those a single machine would find from it, and the coordinator writes them in the order of their indices
+once every shard before them is complete. The output is the same as that of a single worker on one machine, whichever node
+searches which shard, and a shard whose node goes away is handed out again. Every integer of the protocol is big-endian:
+the coordinator first sends a run message, and a node then sends N to ask for a shard, P with the index and the bytes of
+each prime it finds (as written by -f bin, with an 8 byte index in front), and N again once the shard is done. The
+coordinator answers each N with S, the index of the first starting point and the number of primes of the next shard, or E
+once there are no shards left. */
+enum distributed_constants {DISTRIBUTED_MAGIC = 0x4D525044, DISTRIBUTED_VERSION = 1, RUN_FIELDS = 9, SHARD_SIZE = 256,
+	ACCEPT_POLL_MS = 100, MAX_PRIME_BYTES = 1 << 26};
+
+/* This function stores a 64 bit integer as 8 big-endian bytes. */
+static void
+put_u64 (unsigned char *bytes, uint64_t value)
+{
+	for (int i = 7; i >= 0; --i, value >>= 8)
+		bytes[i] = (unsigned char)value;
+}
+
+/* This function reads a 64 bit integer stored as 8 big-endian bytes. */
+static uint64_t
+get_u64 (const unsigned char *bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; ++i)
+		value = value << 8 | bytes[i];
+	return value;
+}
+
+/* The following structure contains a shard of starting points which has not been written yet, and the primes received for it. */
+struct shard_t
+{
+	long first_start; // index of the first starting point of the shard
+	long first_index; // index of the first prime of the shard
+	long count; // number of primes of the shard
+	long received; // number of distinct primes received for it so far
+	enum boolean assigned; // whether a node is searching the shard
+	struct result_t **results; // the results of the primes received so far, by index
+	struct shard_t *next;
+};
+
+/* The following structure contains the state of the coordinator, which is shared by the threads serving the nodes. */
+struct coordinator_t
+{
+	pthread_mutex_t lock; // held while the shards are touched
+	struct writer_t *writer;
+	enum output_format format;
+	long per_start;
+	long num_primes;
+	long shard_size; // number of starting points in each shard
+	long next_start; // index of the first starting point which is in no shard yet
+	struct shard_t *head, *tail; // shards which have not been written yet, in order
+	enum boolean finished; // whether every prime has been written
+	unsigned char run[4 + 8 * RUN_FIELDS]; // run message sent to every node
+};
+
+/* The following structure contains the connection of the coordinator to one node. */
+struct connection_t
+{
+	struct coordinator_t *coordinator;
+	int socket;
+	FILE *in, *out;
+	pthread_t thread;
+};
+
+/* This function hands a shard to a node: the first shard which was given up by the node searching it, or else a new one.
+It returns the index of the first starting point of the shard, and sets the number of its primes, or returns -1 if there
+are no shards left. It is called with the lock of the coordinator held. */
+static long
+coordinator_assign (struct coordinator_t *coordinator, long *count)
+{
+	struct shard_t *shard;
+	for (shard = coordinator->head; shard && shard->assigned; shard = shard->next)
+		continue;
+	if (!shard)
+	{
+		if (coordinator->next_start > (coordinator->num_primes - 1) / coordinator->per_start)
+			return -1;
+		shard = malloc (sizeof (struct shard_t));
+		if (!shard)
+		{
+			fprintf (stderr, "Error: unable to allocate memory for a shard.\n");
+			exit (EXIT_FAILURE);
+		}
+		shard->first_start = coordinator->next_start;
+		shard->first_index = shard->first_start * coordinator->per_start;
+		shard->count = coordinator->num_primes - shard->first_index;
+		if (shard->count / coordinator->per_start >= coordinator->shard_size)
+			shard->count = coordinator->shard_size * coordinator->per_start;
+		shard->received = 0;
+		shard->results = calloc (shard->count, sizeof (struct result_t *));
+		if (!shard->results)
+		{
+			fprintf (stderr, "Error: unable to allocate memory for a shard.\n");
+			exit (EXIT_FAILURE);
+		}
+		shard->next = NULL;
+		if (coordinator->tail)
+			coordinator->tail->next = shard;
+		else
+			coordinator->head = shard;
+		coordinator->tail = shard;
+		coordinator->next_start += coordinator->shard_size;
+	}
+	shard->assigned = TRUE;
+	*count = shard->count;
+	return shard->first_start;
+}
+
+/* This function gives up the shard starting at first_start, unless all of its primes have been received, so that it is handed
+out again. Primes already received for it are kept, since the next node finds the same ones. It is called with the lock held. */
+static void
+coordinator_release (struct coordinator_t *coordinator, long first_start)
+{
+	for (struct shard_t *shard = coordinator->head; shard; shard = shard->next)
+		if (shard->first_start == first_start && shard->received < shard->count)
+			shard->assigned = FALSE;
+}
+
+/* This function records a prime received from a node, and hands the primes of every complete shard at the head of the
+queue to the writer in order. A prime which was already received, or which is not in any shard, is dropped. */
+static void
+coordinator_receive (struct coordinator_t *coordinator, const mpz_t prime, long index)
+{
+	struct result_t *result = format_result (prime, index, coordinator->format);
+	pthread_mutex_lock (&coordinator->lock);
+	struct shard_t *shard;
+	for (shard = coordinator->head; shard && (index < shard->first_index || index - shard->first_index >= shard->count); shard = shard->next)
+		continue;
+	if (shard && !shard->results[index - shard->first_index])
+	{
+		shard->results[index - shard->first_index] = result;
+		++shard->received;
+	}
+	else
+		free (result);
+	
+	while (coordinator->head && coordinator->head->received == coordinator->head->count)
+	{
+		shard = coordinator->head;
+		for (long i = 0; i < shard->count; ++i)
+			writer_submit (coordinator->writer, shard->results[i]);
+		fprintf (status_out, "Primes #%ld to #%ld written\n", shard->first_index + 1, shard->first_index + shard->count);
+		coordinator->head = shard->next;
+		if (!coordinator->head)
+			coordinator->tail = NULL;
+		free (shard->results);
+		free (shard);
+	}
+	if (!coordinator->head && coordinator->next_start > (coordinator->num_primes - 1) / coordinator->per_start)
+		coordinator->finished = TRUE;
+	pthread_mutex_unlock (&coordinator->lock);
+}
+
+/* This method defines the behavior of the thread serving a node: send it the run message, then answer its requests for
+shards and record the primes it sends, until it goes away or there are no shards left. The shard of a node which goes
+away before finishing it is given up. */
+static void *
+serve_node (void *connection_args)
+{
+	struct connection_t *connection = (struct connection_t *)connection_args;
+	struct coordinator_t *coordinator = connection->coordinator;
+	long shard = -1; // first starting point of the shard of the node, or -1
+	unsigned char header[12];
+	unsigned char *bytes = NULL;
+	size_t capacity = 0;
+	mpz_t prime;
+	mpz_init (prime);
+	
+	fwrite (coordinator->run, 1, sizeof (coordinator->run), connection->out);
+	while (!fflush (connection->out))
+	{
+		const int type = fgetc (connection->in);
+		if (type == 'N')
+		{
+			long count = 0;
+			pthread_mutex_lock (&coordinator->lock);
+			if (shard >= 0)
+				coordinator_release (coordinator, shard);
+			shard = coordinator_assign (coordinator, &count);
+			pthread_mutex_unlock (&coordinator->lock);
+			if (shard < 0)
+			{
+				fputc ('E', connection->out);
+				fflush (connection->out);
+				break;
+			}
+			unsigned char message[17] = {'S'};
+			put_u64 (message + 1, (uint64_t)shard);
+			put_u64 (message + 9, (uint64_t)count);
+			fwrite (message, 1, sizeof (message), connection->out);
+		}
+		else if (type == 'P' && fread (header, 1, sizeof (header), connection->in) == sizeof (header))
+		{
+			const long index = (long)get_u64 (header);
+			const size_t length = (size_t)header[8] << 24 | (size_t)header[9] << 16 | (size_t)header[10] << 8 | header[11];
+			if (index < 0 || length > MAX_PRIME_BYTES)
+				break;
+			if (length > capacity)
+			{
+				free (bytes);
+				capacity = length;
+				if (!(bytes = malloc (capacity)))
+				{
+					fprintf (stderr, "Error: unable to allocate memory for a prime.\n");
+					exit (EXIT_FAILURE);
+				}
+			}
+			if (fread (bytes, 1, length, connection->in) < length)
+				break;
+			mpz_import (prime, length, 1, 1, 1, 0, bytes);
+			coordinator_receive (coordinator, prime, index);
+		}
+		else
+			break; // the node went away, the connection was shut down, or the node is not speaking the protocol
+	}
+	if (shard >= 0)
+	{
+		pthread_mutex_lock (&coordinator->lock);
+		coordinator_release (coordinator, shard);
+		pthread_mutex_unlock (&coordinator->lock);
+	}
+	mpz_clear (prime);
+	free (bytes);
+	return NULL;
+}
+
+/* This function opens a TCP socket listening on a port of every local address, or exits if it cannot be opened. */
+static int
+listen_on (const char *port)
+{
+	struct addrinfo hints = {0}, *addresses;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo (NULL, port, &hints, &addresses))
+	{
+		fprintf (stderr, "Error: invalid port %s.\n", port);
+		exit (EXIT_FAILURE);
+	}
+	
+	/* Prefer an IPv6 socket, which also accepts IPv4 connections on most systems. */
+	int listener = -1;
+	for (int family = 0; family < 2 && listener < 0; ++family)
+	{
+		for (struct addrinfo *address = addresses; address && listener < 0; address = address->ai_next)
+		{
+			if ((address->ai_family == AF_INET6) != (family == 0))
+				continue;
+			listener = socket (address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (listener < 0)
+				continue;
+			const int yes = 1, no = 0;
+			setsockopt (listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof (yes));
+			if (address->ai_family == AF_INET6)
+				setsockopt (listener, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof (no));
+			if (bind (listener, address->ai_addr, address->ai_addrlen) || listen (listener, SOMAXCONN))
+			{
+				close (listener);
+				listener = -1;
+			}
+		}
+	}
+	freeaddrinfo (addresses);
+	if (listener < 0)
+	{
+		fprintf (stderr, "Error: unable to listen on port %s.\n", port);
+		exit (EXIT_FAILURE);
+	}
+	return listener;
+}
+
+/* This function runs the coordinator of a distributed generation: it listens on a port for worker nodes, serves each of them
+from a thread of its own, and returns once every prime has been handed to the writer or the search has been stopped. The
+run parameters are sent to the nodes, which search shards of shard_size starting points. */
+static void
+run_coordinator (const char *port, struct writer_t *writer, enum output_format format, long shard_size, uint64_t seed,
+	long num_digits, long num_bits, long per_start, long num_primes, enum boolean safe, enum primality_test test, int precision,
+	enum boolean prefilter)
+{
+	struct coordinator_t coordinator = {.writer = writer, .format = format, .per_start = per_start, .num_primes = num_primes,
+		.shard_size = shard_size, .next_start = 0, .head = NULL, .tail = NULL, .finished = FALSE};
+	pthread_mutex_init (&coordinator.lock, NULL);
+	const uint64_t run[RUN_FIELDS] = {DISTRIBUTED_VERSION, seed, (uint64_t)num_digits, (uint64_t)num_bits, (uint64_t)per_start,
+		(uint64_t)num_primes, (uint64_t)safe << 8 | (uint64_t)prefilter, (uint64_t)test, (uint64_t)precision};
+	coordinator.run[0] = DISTRIBUTED_MAGIC >> 24;
+	coordinator.run[1] = DISTRIBUTED_MAGIC >> 16 & 0xFF;
+	coordinator.run[2] = DISTRIBUTED_MAGIC >> 8 & 0xFF;
+	coordinator.run[3] = DISTRIBUTED_MAGIC & 0xFF;
+	for (int i = 0; i < RUN_FIELDS; ++i)
+		put_u64 (coordinator.run + 4 + 8 * i, run[i]);
+	
+	const int listener = listen_on (port);
+	fprintf (status_out, "Coordinator listening on port %s.\n", port);
+	fflush (status_out);
+	
+	/* Accept nodes until every prime has been written, polling so as to notice that, or a request to stop, in time. */
+	struct connection_t **connections = NULL;
+	long num_connections = 0;
+	for (;;)
+	{
+		pthread_mutex_lock (&coordinator.lock);
+		const enum boolean finished = coordinator.finished;
+		pthread_mutex_unlock (&coordinator.lock);
+		if (finished || atomic_load (&stop_requested))
+			break;
+		struct pollfd pending = {listener, POLLIN, 0};
+		if (poll (&pending, 1, ACCEPT_POLL_MS) <= 0)
+			continue;
+		const int node = accept (listener, NULL, NULL);
+		if (node < 0)
+			continue;
+		struct connection_t *connection = malloc (sizeof (struct connection_t));
+		struct connection_t **grown = realloc (connections, (num_connections + 1) * sizeof (struct connection_t *));
+		if (!connection || !grown)
+		{
+			fprintf (stderr, "Error: unable to allocate memory for a connection.\n");
+			exit (EXIT_FAILURE);
+		}
+		connections = grown;
+		connections[num_connections++] = connection;
+		connection->coordinator = &coordinator;
+		connection->socket = node;
+		connection->in = fdopen (node, "rb");
+		connection->out = fdopen (dup (node), "wb");
+		if (!connection->in || !connection->out)
+		{
+			fprintf (stderr, "Error: unable to open a connection.\n");
+			exit (EXIT_FAILURE);
+		}
+		int return_code = pthread_create (&connection->thread, NULL, serve_node, (void *)connection);
+		if (return_code)
+		{
+			fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+			exit (EXIT_FAILURE);
+		}
+	}
+	close (listener);
+	
+	/* Shutting down the connections wakes the threads waiting on them. A node waiting for its next shard takes the closed
+	connection for the end of the run. */
+	for (long i = 0; i < num_connections; ++i)
+	{
+		shutdown (connections[i]->socket, SHUT_RDWR);
+		int return_code = pthread_join (connections[i]->thread, NULL);
+		if (return_code)
+		{
+			fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
+			exit (EXIT_FAILURE);
+		}
+		fclose (connections[i]->in);
+		fclose (connections[i]->out);
+		free (connections[i]);
+	}
+	free (connections);
+	
+	/* The primes of the shards which were not completed are dropped, since the primes before them are all written already. */
+	while (coordinator.head)
+	{
+		struct shard_t *shard = coordinator.head;
+		coordinator.head = shard->next;
+		for (long i = 0; i < shard->count; ++i)
+			free (shard->results[i]);
+		free (shard->results);
+		free (shard);
+	}
+	pthread_mutex_destroy (&coordinator.lock);
+}
+
+/* The following structure contains the connection of a worker node to its coordinator, and the run parameters it sent. */
+struct node_t
+{
+	FILE *in, *out;
+	pthread_mutex_t lock; // held while a prime is sent
+	long first_index; // index of the first prime of the current shard
+	const struct offset_table_t *table;
+	struct placement_t *placement;
+	long num_threads;
+	uint64_t seed;
+	long num_digits, num_bits, per_start, num_primes;
+	enum boolean safe, prefilter;
+	enum primality_test test;
+	int precision;
+	enum boolean ended; // whether the coordinator said there are no shards left, or closed the connection between shards
+};
+
+/* This function sends a prime found by one of the workers of a node to the coordinator. If the coordinator has gone away,
+the search is stopped. */
+static void
+send_prime (const mpz_t prime, long index, void *node_arg)
+{
+	struct node_t *node = (struct node_t *)node_arg;
+	const size_t length = (mpz_sizeinbase (prime, 2) + 7) / 8;
+	unsigned char *message = malloc (13 + length);
+	if (!message)
+	{
+		fprintf (stderr, "Error: unable to allocate memory for a prime.\n");
+		exit (EXIT_FAILURE);
+	}
+	message[0] = 'P';
+	put_u64 (message + 1, (uint64_t)(node->first_index + index));
+	for (int i = 0; i < 4; ++i)
+		message[9 + i] = (unsigned char)(length >> (24 - 8 * i));
+	mpz_export (message + 13, NULL, 1, 1, 1, 0, prime);
+	pthread_mutex_lock (&node->lock);
+	if (fwrite (message, 1, 13 + length, node->out) < 13 + length)
+		stop_search (&stop_requested, STOP_CLOSED);
+	pthread_mutex_unlock (&node->lock);
+	free (message);
+}
+
+/* This method defines the behavior of the thread of a node which talks to the coordinator: ask for shards and search each of
+them with the workers of the node, sending back the primes as they are found, until there are no shards left. */
+static void *
+run_shards (void *node_args)
+{
+	struct node_t *node = (struct node_t *)node_args;
+	unsigned char message[16];
+	while (!atomic_load (&stop_requested))
+	{
+		if (fputc ('N', node->out) == EOF || fflush (node->out))
+		{
+			stop_search (&stop_requested, STOP_CLOSED);
+			break;
+		}
+		const int type = fgetc (node->in);
+		if (type != 'S' || fread (message, 1, sizeof (message), node->in) < sizeof (message))
+		{
+			node->ended = type == 'E' || type == EOF;
+			break;
+		}
+		const long first_start = (long)get_u64 (message);
+		const long count = (long)get_u64 (message + 8);
+		
+		/* The shard is searched like a run of its own whose random streams start at its first starting point. */
+		struct thread_data_t shard = {node->num_digits, node->precision, node->table, count};
+		thread_args_init (&shard, node->prefilter, node->per_start, node->num_bits, node->seed);
+		shard.first_stream = (uint64_t)first_start;
+		shard.safe = node->safe;
+		shard.test = node->test;
+		shard.placement = node->placement;
+		shard.quiet = TRUE;
+		shard.found = send_prime;
+		shard.found_arg = node;
+		node->first_index = first_start * node->per_start;
+		run_workers (&shard, node->num_threads);
+		const long found = atomic_load (&shard.current_num_primes);
+		mpz_clears (shard.start_low, shard.start_range, NULL);
+		if (found < count)
+			break; // stopped
+		fprintf (status_out, "Primes #%ld to #%ld found\n", node->first_index + 1, node->first_index + count);
+		fflush (status_out);
+	}
+	return NULL;
+}
+
+/* This function runs a worker node of a distributed generation: it connects to the coordinator at an address of the form
+host:port, takes the run parameters from it, and searches the shards which it hands out with num_threads workers. It returns
+whether the node stopped because the run is over, rather than because it was stopped or lost the coordinator. */
+static enum boolean
+run_node (const char *address, const struct offset_table_t *table, struct placement_t *placement, long num_threads)
+{
+	/* The port follows the last colon, and the host may be an IPv6 address in brackets. */
+	char host[1024];
+	const char *colon = strrchr (address, ':');
+	if (!colon || colon == address || (size_t)(colon - address) >= sizeof (host))
+	{
+		fprintf (stderr, "Error: --worker takes the address of the coordinator as host:port.\n");
+		exit (EXIT_FAILURE);
+	}
+	memcpy (host, address, colon - address);
+	host[colon - address] = '\0';
+	if (host[0] == '[' && host[strlen (host) - 1] == ']')
+	{
+		memmove (host, host + 1, strlen (host));
+		host[strlen (host) - 1] = '\0';
+	}
+	struct addrinfo hints = {0}, *addresses;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	int connected = -1;
+	if (!getaddrinfo (host, colon + 1, &hints, &addresses))
+	{
+		for (struct addrinfo *option = addresses; option && connected < 0; option = option->ai_next)
+		{
+			connected = socket (option->ai_family, option->ai_socktype, option->ai_protocol);
+			if (connected >= 0 && connect (connected, option->ai_addr, option->ai_addrlen))
+			{
+				close (connected);
+				connected = -1;
+			}
+		}
+		freeaddrinfo (addresses);
+	}
+	if (connected < 0)
+	{
+		fprintf (stderr, "Error: unable to connect to the coordinator at %s.\n", address);
+		exit (EXIT_FAILURE);
+	}
+	
+	struct node_t node = {fdopen (connected, "rb"), fdopen (dup (connected), "wb")};
+	unsigned char run[4 + 8 * RUN_FIELDS];
+	if (!node.in || !node.out || fread (run, 1, sizeof (run), node.in) < sizeof (run) || get_u64 (run + 4) != DISTRIBUTED_VERSION
+		|| ((uint32_t)run[0] << 24 | (uint32_t)run[1] << 16 | (uint32_t)run[2] << 8 | run[3]) != DISTRIBUTED_MAGIC)
+	{
+		fprintf (stderr, "Error: %s is not a coordinator of this version of the program.\n", address);
+		exit (EXIT_FAILURE);
+	}
+	pthread_mutex_init (&node.lock, NULL);
+	node.table = table;
+	node.placement = placement;
+	node.num_threads = num_threads;
+	node.seed = get_u64 (run + 12);
+	node.num_digits = (long)get_u64 (run + 20);
+	node.num_bits = (long)get_u64 (run + 28);
+	node.per_start = (long)get_u64 (run + 36);
+	node.num_primes = (long)get_u64 (run + 44);
+	node.safe = get_u64 (run + 52) >> 8 & 1;
+	node.prefilter = get_u64 (run + 52) & 1;
+	node.test = (enum primality_test)get_u64 (run + 60);
+	node.precision = (int)get_u64 (run + 68);
+	node.ended = FALSE;
+	fprintf (status_out, "Connected to the coordinator at %s.\n", address);
+	fflush (status_out);
+	
+	/* The shards are searched from a thread which blocks SIGINT, SIGTERM and SIGALRM like the workers, so that they
+	interrupt this thread, which does nothing but wait for it, instead. */
+	pthread_t thread;
+	int return_code = pthread_create (&thread, NULL, run_shards, (void *)&node);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+	sigset_t signals;
+	sigemptyset (&signals);
+	sigaddset (&signals, SIGINT);
+	sigaddset (&signals, SIGTERM);
+	sigaddset (&signals, SIGALRM);
+	pthread_sigmask (SIG_UNBLOCK, &signals, NULL);
+	return_code = pthread_join (thread, NULL);
+	if (return_code)
+	{
+		fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
+		exit (EXIT_FAILURE);
+	}
+	fclose (node.in);
+	fclose (node.out);
+	pthread_mutex_destroy (&node.lock);
+	return node.ended;
+}
+
+/* This function parses a comma separated list of positive integers, such as 100,300,1000, into a newly allocated
+array placed in values, and returns the number of integers in the list, or 0 if the list is not valid. */
+static long
+parse_list (const char *list, long **values)
+{
+	long count = 1;
+	for (const char *c = list; *c; ++c)
+		if (*c == ',')
+			++count;
+	*values = malloc (count * sizeof (long));
+	if (!*values)
+	{
+		fprintf (stderr, "Error: unable to allocate memory for list.\n");
+		exit (EXIT_FAILURE);
+	}
+	
+	char *end;
+	for (long i = 0; i < count; ++i)
+	{
+		errno = 0;
+		(*values)[i] = strtol (list, &end, BASE);
+		if (errno || end == list || (*values)[i] <= 0 || (*end != ',' && *end != '\0'))
+		{
+			free (*values);
+			*values = NULL;
+			return 0;
+		}
+		list = end + 1;
+	}
+	return count;
+}
+
+/* This function runs the benchmark: for every combination of number of digits and number of offset primes,
+it finds num_primes primes from each of the seeds and prints one row of measurements, as JSON or CSV,
+to standard output. The stage times are summed over the workers and the seeds, all other figures are
+totals over the seeds, so that sieved_per_prime and tests_per_prime are comparable between rows. */
+static void
+run_benchmark (const long *digits, const long num_digits, const long *offsets, const long num_offsets,
+	const long *seeds, const long num_seeds, const enum boolean csv, const long num_primes,
+	const long per_start, const int precision, const enum boolean prefilter, const long window, long num_threads)
+{
+	if (num_threads <= 0)
+		num_threads = 1;
+	struct timer_set_t timers;
+	timer_set_init (&timers, num_threads);
+	
+	if (csv)
+	{
+		printf ("digits,offsets,seeds,primes,threads,seconds,primes_per_second,sieved_per_prime,tests_per_prime,init_offsets");
+		for (int stage = 0; stage < NUM_STAGES; ++stage)
+			printf (",%s", stage_names[stage]);
+		printf ("\n");
+	}
+	else
+		printf ("[\n");
+	
+	for (long i = 0; i < num_digits; ++i)
+	{
+		for (long j = 0; j < num_offsets; ++j)
+		{
+			struct offset_table_t table;
+			double lap = timer_now ();
+			table_init (&table, NULL, offsets[j], 0, window);
+			const double init_seconds = timer_now () - lap;
+			const long num_offset_primes = table.num_offsets;
+			
+			double seconds = 0.0, stage_seconds[NUM_STAGES] = {0.0};
+			long counts[NUM_COUNTERS] = {0};
+			long num_workers = num_threads; // the number of workers that run_workers actually starts, which is reported
+			for (long k = 0; k < num_seeds; ++k)
+			{
+				struct thread_data_t thread_args = {digits[i], precision, &table, num_primes};
+				thread_args_init (&thread_args, prefilter, per_start, 0, (uint64_t)seeds[k]);
+				thread_args.quiet = TRUE;
+				thread_args.timers = &timers;
+				timer_set_reset (&timers);
+				
+				num_workers = worker_count (&thread_args, num_threads);
+				lap = timer_now ();
+				run_workers (&thread_args, num_threads);
+				seconds += timer_now () - lap;
+				
+				for (int stage = 0; stage < NUM_STAGES; ++stage)
+					stage_seconds[stage] += timer_total_seconds (&timers, stage);
+				for (int counter = 0; counter < NUM_COUNTERS; ++counter)
+					counts[counter] += timer_total_count (&timers, counter);
+				mpz_clears (thread_args.start_low, thread_args.start_range, NULL);
+			}
+			table_free (&table);
+			
+			if (csv)
+			{
+				printf ("%ld,%ld,%ld,%ld,%ld,%.6f,%.3f,%.3f,%.3f,%.6f", digits[i], num_offset_primes, num_seeds, counts[COUNT_PRIMES], num_workers, seconds,
+					counts[COUNT_PRIMES] / seconds, (double)counts[COUNT_SIEVED] / counts[COUNT_PRIMES], (double)counts[COUNT_TESTS] / counts[COUNT_PRIMES], init_seconds);
+				for (int stage = 0; stage < NUM_STAGES; ++stage)
+					printf (",%.6f", stage_seconds[stage]);
+				printf ("\n");
+			}
+			else
+			{
+				printf ("  {\"digits\": %ld, \"offsets\": %ld, \"seeds\": %ld, \"primes\": %ld, \"threads\": %ld, \"seconds\": %.6f, ",
+					digits[i], num_offset_primes, num_seeds, counts[COUNT_PRIMES], num_workers, seconds);
+				printf ("\"primes_per_second\": %.3f, \"sieved_per_prime\": %.3f, \"tests_per_prime\": %.3f, ",
+					counts[COUNT_PRIMES] / seconds, (double)counts[COUNT_SIEVED] / counts[COUNT_PRIMES], (double)counts[COUNT_TESTS] / counts[COUNT_PRIMES]);
+				printf ("\"stages\": {\"init_offsets\": %.6f", init_seconds);
+				for (int stage = 0; stage < NUM_STAGES; ++stage)
+					printf (", \"%s\": %.6f", stage_names[stage], stage_seconds[stage]);
+				printf ("}}%s\n", i == num_digits - 1 && j == num_offsets - 1 ? "" : ",");
+			}
+			fflush (stdout);
+		}
+	}
+	
+	if (!csv)
+		printf ("]\n");
+	timer_set_free (&timers);
+}
+
+/* The kernel benchmark times each hot function of the search on its own. Every measurement takes KERNEL_SAMPLES samples
+by default, each of which repeats the function until it has taken at least KERNEL_MIN_SECONDS, and reports the median,
+the minimum and the median absolute deviation of the time per call over the samples of every seed, which the noise of
+a busy machine hardly moves. Every sample of miller_rabin tests the same candidates, taken in order from the first
+KERNEL_CANDIDATES which survive the sieve, so that the samples only differ by noise. */
+enum kernel {KERNEL_INIT_OFFSETS, KERNEL_OFFSET_INIT, KERNEL_SIEVE_WINDOW, KERNEL_ADVANCE_OFFSETS, KERNEL_NEXT_TEST,
+	KERNEL_MILLER_RABIN, KERNEL_MILLER_RABIN_PRIME, KERNEL_FORMAT_RESULT, KERNEL_WRITER, NUM_KERNELS};
+static const char *kernel_names[NUM_KERNELS] = {"init_offsets", "offset_init", "sieve_window", "advance_offsets", "next_test",
+	"miller_rabin", "miller_rabin_prime", "format_result", "writer"};
+enum kernel_constants {KERNEL_SAMPLES = 15, KERNEL_CANDIDATES = 256};
+#define KERNEL_MIN_SECONDS 0.01
+
+/* The following structure contains the inputs of the kernels for one number of digits and one seed. */
+struct kernel_bench_t
+{
+	const struct offset_table_t *table;
+	long num_offsets, sieve_limit; // arguments of init_offsets
+	struct sieve_t sieve;
+	struct scratch_t scratch;
+	gmp_randstate_t random;
+	mpz_t start; // starting point generated from the seed
+	mpz_t prime; // first prime after the starting point
+	mpz_t test_value;
+	mpz_t candidates[KERNEL_CANDIDATES];
+	long probable_primes; // number of Miller-Rabin tests passed, counted so that the tests are not optimized away
+	int precision;
+	enum boolean prefilter;
+	enum output_format format;
+};
+
+/* This function calls a kernel reps times. */
+static void
+run_kernel (struct kernel_bench_t *bench, enum kernel kernel, long reps)
+{
+	struct offset_table_t table;
+	struct writer_t writer;
+	switch (kernel)
+	{
+		case KERNEL_INIT_OFFSETS:
+			for (long i = 0; i < reps; ++i)
+			{
+				init_offsets (&table, bench->num_offsets, bench->sieve_limit);
+				free_offsets (&table);
+			}
+			break;
+		case KERNEL_OFFSET_INIT:
+			for (long i = 0; i < reps; ++i)
+				offset_init (bench->start, &bench->sieve);
+			break;
+		case KERNEL_SIEVE_WINDOW:
+			for (long i = 0; i < reps; ++i)
+				sieve_window (&bench->sieve);
+			break;
+		case KERNEL_ADVANCE_OFFSETS:
+			for (long i = 0; i < reps; ++i)
+				advance_offsets (&bench->sieve);
+			break;
+		case KERNEL_NEXT_TEST:
+			for (long i = 0; i < reps; ++i)
+				next_test (bench->test_value, &bench->sieve);
+			break;
+		case KERNEL_MILLER_RABIN:
+			for (long i = 0; i < reps; ++i)
+				bench->probable_primes += miller_rabin (bench->candidates[i % KERNEL_CANDIDATES], bench->precision, bench->prefilter,
+					bench->random, &bench->scratch) == VERDICT_PROBABLE_PRIME;
+			break;
+		case KERNEL_MILLER_RABIN_PRIME:
+			for (long i = 0; i < reps; ++i)
+				bench->probable_primes += miller_rabin (bench->prime, bench->precision, bench->prefilter, bench->random,
+					&bench->scratch) == VERDICT_PROBABLE_PRIME;
+			break;
+		case KERNEL_FORMAT_RESULT:
+			for (long i = 0; i < reps; ++i)
+				free (format_result (bench->prime, i, bench->format));
+			break;
+		default:
+			/* The writer is timed from handing it the first result to closing the output after the last one. */
+			writer_start (&writer, "/dev/null", FALSE, 0, 0);
+			for (long i = 0; i < reps; ++i)
+				writer_submit (&writer, format_result (bench->prime, i, bench->format));
+			writer_finish (&writer);
+	}
+}
+
+/* This function measures a kernel: the number of calls per sample is doubled from 1 until a sample takes at least
+KERNEL_MIN_SECONDS, and then num_samples samples are taken, whose times per call are stored in seconds. */
+static void
+measure_kernel (struct kernel_bench_t *bench, enum kernel kernel, long num_samples, double *seconds)
+{
+	long reps = 1;
+	double lap = timer_now ();
+	run_kernel (bench, kernel, reps);
+	while (timer_now () - lap < KERNEL_MIN_SECONDS)
+	{
+		reps *= 2;
+		lap = timer_now ();
+		run_kernel (bench, kernel, reps);
+	}
+	for (long i = 0; i < num_samples; ++i)
+	{
+		lap = timer_now ();
+		run_kernel (bench, kernel, reps);
+		seconds[i] = (timer_now () - lap) / reps;
+	}
+}
+
+/* This function compares two doubles for qsort. */
+static int
+compare_doubles (const void *x, const void *y)
+{
+	const double a = *(const double *)x, b = *(const double *)y;
+	return (a > b) - (a < b);
+}
+
+/* This function sorts the samples of a kernel and prints their statistics as one row of JSON or CSV. */
+static void
+print_kernel (enum kernel kernel, long digits, const struct offset_table_t *table, long num_seeds, double *seconds,
+	long num_samples, const enum boolean csv, const enum boolean last)
+{
+	qsort (seconds, num_samples, sizeof (double), compare_doubles);
+	const double median = num_samples % 2 ? seconds[num_samples / 2] : (seconds[num_samples / 2 - 1] + seconds[num_samples / 2]) / 2;
+	double *deviations = malloc (num_samples * sizeof (double));
+	if (!deviations)
+	{
+		fprintf (stderr, "Error: failure to allocate benchmark samples.\n");
+		exit (EXIT_FAILURE);
+	}
+	for (long i = 0; i < num_samples; ++i)
+		deviations[i] = seconds[i] > median ? seconds[i] - median : median - seconds[i];
+	qsort (deviations, num_samples, sizeof (double), compare_doubles);
+	const double deviation = num_samples % 2 ? deviations[num_samples / 2] : (deviations[num_samples / 2 - 1] + deviations[num_samples / 2]) / 2;
+	free (deviations);
+	
+	if (csv)
+		printf ("%s,%ld,%ld,%ld,%ld,%ld,%.1f,%.1f,%.1f\n", kernel_names[kernel], digits, table->num_offsets, table->window, num_seeds,
+			num_samples, median * 1e9, seconds[0] * 1e9, deviation * 1e9);
+	else
+		printf ("  {\"kernel\": \"%s\", \"digits\": %ld, \"offsets\": %ld, \"window\": %ld, \"seeds\": %ld, \"samples\": %ld, "
+			"\"median_ns\": %.1f, \"min_ns\": %.1f, \"mad_ns\": %.1f}%s\n", kernel_names[kernel], digits, table->num_offsets, table->window,
+			num_seeds, num_samples, median * 1e9, seconds[0] * 1e9, deviation * 1e9, last ? "" : ",");
+	fflush (stdout);
+}
+
+/* This function runs the kernel benchmark with the offset primes of a table, one row for init_offsets followed by one row
+for each other kernel and each number of digits, as JSON or CSV, to standard output. The inputs for each seed are the starting
+point of the first random stream of that seed, the candidates which survive the sieve from it, and the first prime after it. */
+static void
+run_kernel_benchmark (const long *digits, const long num_digits, const long *seeds, const long num_seeds, const enum boolean csv,
+	const struct offset_table_t *table, const long num_offsets, const long sieve_limit, const long num_samples,
+	const int precision, const enum boolean prefilter, const enum output_format format)
+{
+	double *seconds = malloc ((NUM_KERNELS - 1) * num_seeds * num_samples * sizeof (double));
+	if (!seconds)
+	{
+		fprintf (stderr, "Error: failure to allocate benchmark samples.\n");
+		exit (EXIT_FAILURE);
+	}
+	if (csv)
+		printf ("kernel,digits,offsets,window,seeds,samples,median_ns,min_ns,mad_ns\n");
+	else
+		printf ("[\n");
+	
+	struct kernel_bench_t bench = {table, num_offsets, sieve_limit};
+	bench.precision = precision;
+	bench.prefilter = prefilter;
+	bench.format = format;
+	measure_kernel (&bench, KERNEL_INIT_OFFSETS, num_samples, seconds);
+	print_kernel (KERNEL_INIT_OFFSETS, 0, table, 1, seconds, num_samples, csv, FALSE);
+	
+	mpz_t low, range;
+	mpz_inits (low, range, bench.start, bench.prime, NULL);
+	for (long i = 0; i < KERNEL_CANDIDATES; ++i)
+		mpz_init (bench.candidates[i]);
+	gmp_randinit_mt (bench.random);
+	for (long i = 0; i < num_digits; ++i)
+	{
+		init_start_bounds (low, range, digits[i]);
+		const mp_bitcnt_t max_bits = mpz_sizeinbase (low, 2) + 4;
+		mpz_init2 (bench.test_value, max_bits);
+		sieve_init (&bench.sieve, table, max_bits, FALSE);
+		scratch_init (&bench.scratch, max_bits);
+		for (long j = 0; j < num_seeds; ++j)
+		{
+			seed_stream (bench.random, (uint64_t)seeds[j], 0, bench.scratch.stream_seed);
+			gen_start (bench.start, low, range, bench.random);
+			mpz_nextprime (bench.prime, bench.start);
+			sieve_start (&bench.sieve, bench.start);
+			for (long k = 0; k < KERNEL_CANDIDATES; ++k)
+				next_test (bench.candidates[k], &bench.sieve);
+			
+			/* The sieve is restarted for next_test, after the other sieve kernels have run on it. */
+			for (int kernel = KERNEL_OFFSET_INIT; kernel < NUM_KERNELS; ++kernel)
+			{
+				if (kernel == KERNEL_NEXT_TEST)
+					sieve_start (&bench.sieve, bench.start);
+				measure_kernel (&bench, kernel, num_samples, seconds + ((kernel - 1) * num_seeds + j) * num_samples);
+			}
+		}
+		for (int kernel = KERNEL_OFFSET_INIT; kernel < NUM_KERNELS; ++kernel)
+			print_kernel (kernel, digits[i], table, num_seeds, seconds + (kernel - 1) * num_seeds * num_samples, num_seeds * num_samples,
+				csv, i == num_digits - 1 && kernel == NUM_KERNELS - 1);
+		sieve_clear (&bench.sieve);
+		scratch_clear (&bench.scratch);
+		mpz_clear (bench.test_value);
+	}
+	
+	if (!csv)
+		printf ("]\n");
+	gmp_randclear (bench.random);
+	for (long i = 0; i < KERNEL_CANDIDATES; ++i)
+		mpz_clear (bench.candidates[i]);
+	mpz_clears (low, range, bench.start, bench.prime, NULL);
+	free (seconds);
+}
+
+/* The autotuner tries every power of 2 times AUTOTUNE_MIN_OFFSETS offset primes up to AUTOTUNE_MAX_OFFSETS and every power of 2
+window size from AUTOTUNE_MIN_WINDOW to AUTOTUNE_MAX_WINDOW, and times up to AUTOTUNE_TESTS Miller-Rabin tests. */
+enum autotune_constants {AUTOTUNE_MIN_OFFSETS = 1000, AUTOTUNE_MAX_OFFSETS = 4096000, AUTOTUNE_MIN_WINDOW = 1024, AUTOTUNE_MAX_WINDOW = 262144,
+	AUTOTUNE_TESTS = 1000, PROFILE_VERSION = 1};
+#define AUTOTUNE_MIN_SECONDS 0.02 // each measurement is repeated until it has taken at least this long
+
+/* This function chooses the number of offset primes and the window size which minimize the expected time to find a prime
+of the given size, from short measurements of each stage of the search on this machine:
+	time per prime = (t_init + (1 + L / W) * t_window + L * S * t_test) / per_start
+where L = per_start * ln(n) / 2 is the expected number of odd integers passed over from a starting point near n, t_init is the
+time offset_init takes, t_window the time to sieve a window of W odd integers and advance the offsets past it, S the fraction of
+odd integers which are not divisible by any offset prime, and t_test the time taken by a Miller-Rabin test which rejects one of them. */
+static void
+autotune_calibrate (const char *table_name, const long num_digits, const long num_bits, const long per_start, const enum boolean prefilter,
+	long *best_offsets, long *best_window)
+{
+	/* Every measurement starts from the same starting point, generated with a fixed seed. */
+	gmp_randstate_t random;
+	gmp_randinit_mt (random);
+	mpz_t low, range, start, candidate;
+	mpz_inits (low, range, start, candidate, NULL);
+	init_start_bounds (low, range, num_digits);
+	const mp_bitcnt_t max_bits = num_bits ? (mp_bitcnt_t)num_bits + 1 : mpz_sizeinbase (low, 2) + 4;
+	struct scratch_t scratch;
+	scratch_init (&scratch, max_bits);
+	seed_stream (random, 0, 0, scratch.stream_seed);
+	if (num_bits)
+		gen_start_bits (start, num_bits, random);
+	else
+		gen_start (start, low, range, random);
+	const double sieved_per_start = per_start * mpz_sizeinbase (start, 2) * 0.6931471805599453 / 2;
+	
+	/* Time the Miller-Rabin tests which reject candidates that survive the default sieve. */
+	struct offset_table_t table;
+	struct sieve_t sieve;
+	table_init (&table, NULL, 10000, 0, SIEVE_WINDOW);
+	sieve_init (&sieve, &table, max_bits, FALSE);
+	sieve_start (&sieve, start);
+	double test_seconds = 0.0;
+	long rejected = 0;
+	for (long tested = 0; tested < AUTOTUNE_TESTS && test_seconds < 10 * AUTOTUNE_MIN_SECONDS; ++tested)
+	{
+		next_test (candidate, &sieve);
+		const double lap = timer_now ();
+		if (miller_rabin (candidate, 1, prefilter, random, &scratch) == VERDICT_COMPOSITE)
+		{
+			test_seconds += timer_now () - lap;
+			++rejected;
+		}
+	}
+	/* For small primes, every candidate which survives the sieve may be prime, and then there is no time spent on rejections. */
+	test_seconds = rejected ? test_seconds / rejected : 0.0;
+	sieve_clear (&sieve);
+	table_free (&table);
+	
+	double best_seconds = -1.0;
+	long tuned_offsets = AUTOTUNE_MIN_OFFSETS, tuned_window = SIEVE_WINDOW;
+	for (long offsets = AUTOTUNE_MIN_OFFSETS; offsets <= AUTOTUNE_MAX_OFFSETS; offsets *= 2)
+	{
+		/* The offset primes are taken from the table file if it holds enough of them, but the table file is not replaced
+		with the primes generated for each size tried: it is written once, with the chosen number, when the table is built. */
+		table.window = SIEVE_WINDOW;
+		if (!table_name || !map_offset_table (&table, table_name, offsets, 0))
+			init_offsets (&table, offsets, 0);
+		init_offset_groups (&table);
+		init_offset_wraps (&table);
+		double survivors = 1.0;
+		for (long i = 0; i < table.num_offsets; ++i)
+			survivors *= 1.0 - 1.0 / table.primes[i];
+		
+		/* Time offset_init, and stop once it alone takes longer than the best time per prime so far, since it only grows with more offset primes. */
+		sieve_init (&sieve, &table, max_bits, FALSE);
+		long reps = 0;
+		double lap = timer_now (), init_seconds;
+		do
+		{
+			offset_init (start, &sieve);
+			++reps;
+		}
+		while ((init_seconds = timer_now () - lap) < AUTOTUNE_MIN_SECONDS);
+		init_seconds /= reps;
+		sieve_clear (&sieve);
+		if (best_seconds >= 0 && init_seconds / per_start > best_seconds)
+		{
+			table_free (&table);
+			break;
+		}
+		
+		/* Time sieving windows of each size, which needs the wraps and the bitmap for that size. Once a larger
+		window takes longer per prime than the one before it, the even larger ones are not tried. */
+		double last_seconds = -1.0;
+		for (long window = AUTOTUNE_MIN_WINDOW; window <= AUTOTUNE_MAX_WINDOW; window *= 2)
+		{
+			free_offset_wraps (&table);
+			table.window = window;
+			init_offset_wraps (&table);
+			sieve_init (&sieve, &table, max_bits, FALSE);
+			sieve_start (&sieve, start);
+			double window_seconds;
+			reps = 0;
+			lap = timer_now ();
+			do
+			{
+				sieve_window (&sieve);
+				advance_offsets (&sieve);
+				++reps;
+			}
+			while ((window_seconds = timer_now () - lap) < AUTOTUNE_MIN_SECONDS);
+			window_seconds /= reps;
+			sieve_clear (&sieve);
+			
+			const double seconds = (init_seconds + (1 + sieved_per_start / window) * window_seconds
+				+ sieved_per_start * survivors * test_seconds) / per_start;
+			if (best_seconds < 0 || seconds < best_seconds)
+			{
+				best_seconds = seconds;
+				tuned_offsets = table.num_offsets;
+				tuned_window = window;
+			}
+			if (last_seconds >= 0 && seconds > last_seconds)
+				break;
+			last_seconds = seconds;
+		}
+		table_free (&table);
+	}
+	
+	*best_offsets = tuned_offsets;
+	*best_window = tuned_window;
+	scratch_clear (&scratch);
+	mpz_clears (low, range, start, candidate, NULL);
+	gmp_randclear (random);
+}
+
+/* This function looks up the tuned number of offset primes and window size for a host and a search in the profile file,
+and returns whether they were found. Each line of the file is one tuning: the version of the file format, the host name,
+the size of the primes as d followed by the number of digits or b followed by the number of bits, the number of primes per
+starting point, whether the base 2 round is performed, the number of offset primes and the window size. Lines of other
+versions are skipped, and the last matching line is used. */
+static enum boolean
+profile_read (const char *file_name, const char *host, const char *size, const long per_start, const enum boolean prefilter,
+	long *num_offsets, long *window)
+{
+	FILE *profile = fopen (file_name, "r");
+	if (!profile)
+		return FALSE;
+	
+	char line[512], line_host[256], line_size[32];
+	int version, line_prefilter;
+	long line_per_start, line_offsets, line_window;
+	enum boolean found = FALSE;
+	while (fgets (line, sizeof (line), profile))
+	{
+		if (sscanf (line, "%d %255s %31s %ld %d %ld %ld", &version, line_host, line_size, &line_per_start, &line_prefilter,
+				&line_offsets, &line_window) == 7
+			&& version == PROFILE_VERSION && strcmp (line_host, host) == 0 && strcmp (line_size, size) == 0
+			&& line_per_start == per_start && line_prefilter == (int)prefilter && line_offsets > 0
+			&& line_window >= MIN_SIEVE_WINDOW && line_window <= MAX_SIEVE_WINDOW && line_window % 64 == 0)
+		{
+			*num_offsets = line_offsets;
+			*window = line_window;
+			found = TRUE;
+		}
+	}
+	fclose (profile);
+	return found;
+}
+
+/* This function appends a tuning to the profile file. Failing to do so is not an error, since the tuning can be found again. */
+static void
+profile_write (const char *file_name, const char *host, const char *size, const long per_start, const enum boolean prefilter,
+	const long num_offsets, const long window)
+{
+	FILE *profile = fopen (file_name, "a");
+	if (!profile)
+	{
+		fprintf (stderr, "Warning: unable to write autotune profile %s.\n", file_name);
+		return;
+	}
+	fprintf (profile, "%d %s %s %ld %d %ld %ld\n", PROFILE_VERSION, host, size, per_start, (int)prefilter, num_offsets, window);
+	fclose (profile);
+}
+
+/* This function sets the number of offset primes and the window size for a search, from the profile file if this host has
+already been tuned for the search, and otherwise by calibrating them and adding them to the profile file. If profile_name
+is NULL, the profile file is $HOME/.mrprimes_profile, or none if HOME is not set. The offset primes are loaded from the
+table file if table_name is not NULL. */
+static void
+autotune (const char *profile_name, const char *table_name, const long num_digits, const long num_bits, const long per_start, const enum boolean prefilter,
+	long *num_offsets, long *window)
+{
+	char host[256] = "localhost", size[32], default_name[4096];
+	if (gethostname (host, sizeof (host) - 1))
+		strcpy (host, "localhost");
+	host[sizeof (host) - 1] = '\0';
+	for (char *c = host; *c; ++c)
+		if (*c == ' ' || *c == '\t' || *c == '\n')
+			*c = '_';
+	snprintf (size, sizeof (size), "%c%ld", num_bits ? 'b' : 'd', num_bits ? num_bits : num_digits);
+	if (!profile_name && getenv ("HOME"))
+	{
+		snprintf (default_name, sizeof (default_name), "%s/.mrprimes_profile", getenv ("HOME"));
+		profile_name = default_name;
+	}
+	
+	if (profile_name && profile_read (profile_name, host, size, per_start, prefilter, num_offsets, window))
+	{
+		fprintf (status_out, "Autotune: using %ld offset primes and a window of %ld from %s.\n", *num_offsets, *window, profile_name);
+		return;
+	}
+	const double start = timer_now ();
+	autotune_calibrate (table_name, num_digits, num_bits, per_start, prefilter, num_offsets, window);
+	fprintf (status_out, "Autotune: chose %ld offset primes and a window of %ld in %.3f seconds.\n", *num_offsets, *window, timer_now () - start);
+	if (profile_name)
+		profile_write (profile_name, host, size, per_start, prefilter, *num_offsets, *window);
+}
+
+/* Thus method prints the version number and a copyright message. */
+static void
+print_version ()
+{
+	printf ("\tMRPrimes %s\n", VERSION_NUMBER_STRING);
+	printf ("\tCopyright (C) 2012, 2013 Evan Brown\n");
+	printf ("\tLicense GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>\n");
+	printf ("\tThis is free software: you are free to change and redistribute it.\n");
+	printf ("\tThere is NO WARRANTY, to the extent permitted by law.\n");
+}
+
+/* This method prints a usage message. */
+static void
+print_help ()
+{
+	printf ("usage:\n");
+	printf ("\t-o set output file (- for standard output)\n");
+	printf ("\t-n set number of primes to generate (0 for no limit)\n");
+	printf ("\t--per-start set number of consecutive primes to find from each random starting point\n");
+	printf ("\t-d set number of digits of primes to generate\n");
+	printf ("\t-b set number of bits of primes to generate (overrides -d)\n");
+	printf ("\t-p set number of rounds of Miller-Rabin test to perform\n");
+	printf ("\t-O set number of offset primes to generate\n");
+	printf ("\t-L set largest offset prime to generate (overrides -O)\n");
+	printf ("\t--check check the numbers in a file (- for standard input) instead of generating primes\n");
+	printf ("\t-T set file in which offset primes are kept between runs\n");
+	printf ("\t-W set number of odd integers sieved at once\n");
+	printf ("\t--autotune choose number of offset primes and window size by calibration (overrides -O, -L and -W)\n");
+	printf ("\t--profile set file in which autotune results are kept\n");
+	printf ("\t-s set random seed\n");
+	printf ("\t-j set number of worker threads\n");
+	printf ("\t--coordinator hand out the search to worker nodes connecting on this port\n");
+	printf ("\t--worker search for the coordinator at this host:port\n");
+	printf ("\t--shard-size set number of starting points handed to a worker node at once\n");
+	printf ("\t--affinity pin the worker threads to processors (none, compact, scatter or a list such as 0-3,8)\n");
+	printf ("\t--test set test performed on the candidates (mr for Miller-Rabin, or bpsw for Baillie-PSW)\n");
+	printf ("\t--safe generate safe primes p = 2q + 1 where q is also prime\n");
+	printf ("\t-F skip the base 2 round performed before the randomized rounds of the Miller-Rabin test\n");
+	printf ("\t-f set format of output file (dec, hex, or bin)\n");
+	printf ("\t-a set whether to append output to an existing file\n");
+	printf ("\t--sync-every sync the output file to disk after this many primes\n");
+	printf ("\t--sync-ms sync the output file to disk this many milliseconds after a prime is written\n");
+	printf ("\t--timeout stop searching after this many seconds\n");
+	printf ("\t--max-candidates stop searching after testing this many candidates\n");
+	printf ("\t--checkpoint save the state of the search to this file\n");
+	printf ("\t--checkpoint-every seconds between checkpoints\n");
+	printf ("\t--resume continue the run saved in the checkpoint file\n");
+	printf ("\t--progress print the rates at which candidates are sieved and tested every this many seconds\n");
+	printf ("\t--bench run the benchmark and print its measurements instead of generating primes\n");
+	printf ("\t--bench-digits set comma separated numbers of digits to benchmark\n");
+	printf ("\t--bench-offsets set comma separated numbers of offset primes to benchmark\n");
+	printf ("\t--bench-seeds set comma separated random seeds to benchmark\n");
+	printf ("\t--bench-format set format of the benchmark measurements (json or csv)\n");
+	printf ("\t--bench-kernels time each kernel of the search on its own instead of generating primes\n");
+	printf ("\t--bench-samples set number of samples taken of each kernel per seed\n");
+	printf ("\t-h print this help information\n");
+	printf ("\t-v print program version information\n");
+}
+
+#ifndef MRPRIMES_LIBRARY
+/* The main method generates prime numbers based on the command line arguments. It is left out when mrprimes.c is compiled as part of the library (see libmrprimes.c). */
+int
+main (int argc, char *argv[])
+{
+	/* Set default argument values. */
+	char out_file_name[11] = "primes.txt";
+	char *out_file_name_pointer = out_file_name; // output file name (-o)
+	long num_digits = 300; // number of digits of primes to generate (-d)
+	long num_primes = 10; // number of primes to generate (-n)
+	long per_start = 1; // number of consecutive primes to find from each starting point (--per-start)
+	long num_bits = 0; // number of bits of primes to generate, overriding num_digits if not 0 (-b)
+	long num_offsets = 10000; // number of offset primes (-O)
+	long sieve_limit = 0; // largest value of offset primes, overriding num_offsets if not 0 (-L)
+	long window = SIEVE_WINDOW; // number of odd integers sieved at once (-W)
+	const char *table_name = NULL; // file in which offset primes are kept between runs (-T)
+	const char *check_name = NULL; // file of candidates to check instead of generating primes (--check)
+	int precision = 8; // rounds of Miller-Rabin test to perform (-p)
+	long num_threads = sysconf (_SC_NPROCESSORS_ONLN); // number of worker threads (-j)
+	uint64_t seed = (uint64_t)time (NULL); // random seed (-s)
+	enum boolean append = FALSE; // whether the program should try to append output to an existing file (-a)
+	enum output_format format = FORMAT_DECIMAL; // format of the primes in the output file (-f)
+	long sync_every = 0; // number of primes after which the output file is synced to disk (--sync-every)
+	long sync_ms = 0; // number of milliseconds after which a prime written to the output file is synced to disk (--sync-ms)
+	enum boolean prefilter = TRUE; // whether to perform a base 2 round before the randomized rounds (-F disables)
+	enum boolean safe = FALSE; // whether to generate safe primes (--safe)
+	enum primality_test test = TEST_MILLER_RABIN; // engine used to test the candidates (--test)
+	enum boolean tune = FALSE; // whether to choose num_offsets and the window size by calibration (--autotune)
+	char *profile_name = NULL; // file in which tunings are kept (--profile)
+	long progress_interval = 0; // seconds between progress reports, or 0 for no reports (--progress)
+	const char *coordinator_port = NULL; // port on which to hand out the search to worker nodes (--coordinator)
+	const char *node_address = NULL; // address of the coordinator whose shards to search (--worker)
+	long shard_size = SHARD_SIZE; // number of starting points in each shard handed out by the coordinator (--shard-size)
+	const char *affinity = NULL; // placement of the workers on the processors, or NULL to let them run anywhere (--affinity)
+	long timeout = 0; // seconds after which the search is stopped, or 0 for no limit (--timeout)
+	const char *checkpoint_name = NULL; // file to which the state of the search is saved (--checkpoint)
+	long checkpoint_interval = 60; // seconds between checkpoints (--checkpoint-every)
+	enum boolean resume = FALSE; // whether to resume the run saved in the checkpoint file (--resume)
+	long max_candidates = 0; // number of candidates tested before the search is stopped, or 0 for no limit (--max-candidates)
+	enum boolean bench = FALSE; // whether to run the benchmark instead of generating primes (--bench)
+	enum boolean bench_kernels = FALSE; // whether to run the kernel benchmark instead of generating primes (--bench-kernels)
+	long bench_samples = KERNEL_SAMPLES; // samples taken of each kernel per seed (--bench-samples)
+	enum boolean bench_format = FALSE; // whether the benchmark prints CSV rather than JSON (--bench-format)
+	long *bench_digits = NULL, *bench_offsets = NULL, *bench_seeds = NULL; // benchmark matrix (--bench-digits, --bench-offsets, --bench-seeds)
+	long num_bench_digits = 0, num_bench_offsets = 0, num_bench_seeds = 0;
+	
+	/* Set argument values and check for validity. */
+	if (argc > 1)
+	{
+		char **invalid_int = NULL; // for checking whether integer arguments are valid
+		
+		for (int i = 1; i < argc; ++i)
+		{
+			if (strcmp (argv[i], "-o") == 0 || strcmp (argv[i], "--output") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					out_file_name_pointer = argv[i];
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-O") == 0 || strcmp (argv[i], "--numoffsets") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					num_offsets = strtol (argv[i], invalid_int, BASE);
+					if (num_offsets <= 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of offset primes must be a valid integer greater than 0.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-L") == 0 || strcmp (argv[i], "--sieve-limit") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					sieve_limit = strtol (argv[i], invalid_int, BASE);
+					if (sieve_limit < 3 || sieve_limit > MAX_OFFSET_PRIME || invalid_int)
+					{
+						fprintf (stderr, "Error: sieve limit must be a valid integer from 3 to %ld.\n", (long)MAX_OFFSET_PRIME);
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-n") == 0 || strcmp (argv[i], "--numprimes") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					num_primes = strtol (argv[i], invalid_int, BASE);
+					if (num_primes < 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of primes must be a valid integer greater than or equal to 0.\n");
+						return EXIT_FAILURE;
+					}
+					if (!num_primes)
+						num_primes = LONG_MAX; // until the output is closed or the program is interrupted
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--per-start") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					per_start = strtol (argv[i], invalid_int, BASE);
+					if (per_start <= 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of primes per starting point must be a valid integer greater than 0.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-d") == 0 || strcmp (argv[i], "--numdigits") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					num_digits = strtol (argv[i], invalid_int, BASE);
+					if (num_digits < 10 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of digits must be a valid integer greater than or equal to 10.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-b") == 0 || strcmp (argv[i], "--bits") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					num_bits = strtol (argv[i], invalid_int, BASE);
+					if (num_bits < 32 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of bits must be a valid integer greater than or equal to 32.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-s") == 0 || strcmp (argv[i], "--seed") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					/* Create a temporary long int to test for a negative value. */
+					long seed_temp = strtol (argv[i], invalid_int, BASE);
+					if (seed_temp < 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: seed value must be a valid long integer greater than or equal to 0.\n");
+						return EXIT_FAILURE;
+					}
+					seed = seed_temp;
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-p") == 0 || strcmp (argv[i], "--precision") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					precision = strtol (argv[i], invalid_int, BASE);
+					if (precision <= 0 || precision >= 200 || invalid_int)
+					{
+						fprintf (stderr, "Error: Miller Rabin test precision must be a valid integer greater than 0 and less than 200.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-j") == 0 || strcmp (argv[i], "--threads") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					num_threads = strtol (argv[i], invalid_int, BASE);
+					if (num_threads <= 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of threads must be a valid integer greater than 0.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-F") == 0 || strcmp (argv[i], "--no-prefilter") == 0)
+			{
+				prefilter = FALSE;
+			}
+			else if (strcmp (argv[i], "--test") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					if (strcmp (argv[i], "mr") == 0)
+						test = TEST_MILLER_RABIN;
+					else if (strcmp (argv[i], "bpsw") == 0)
+						test = TEST_BPSW;
+					else
+					{
+						fprintf (stderr, "Error: test must be mr or bpsw.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--safe") == 0)
+			{
+				safe = TRUE;
+			}
+			else if (strcmp (argv[i], "-f") == 0 || strcmp (argv[i], "--format") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					if (strcmp (argv[i], "dec") == 0)
+						format = FORMAT_DECIMAL;
+					else if (strcmp (argv[i], "hex") == 0)
+						format = FORMAT_HEX;
+					else if (strcmp (argv[i], "bin") == 0)
+						format = FORMAT_BINARY;
+					else
+					{
+						fprintf (stderr, "Error: output format must be dec, hex, or bin.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--sync-every") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					sync_every = strtol (argv[i], invalid_int, BASE);
+					if (sync_every <= 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of primes between syncs must be a valid integer greater than 0.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--sync-ms") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					sync_ms = strtol (argv[i], invalid_int, BASE);
+					if (sync_ms <= 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: number of milliseconds between syncs must be a valid integer greater than 0.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-a") == 0 || strcmp (argv[i], "--append") == 0)
+			{
+				append = TRUE;
+			}
+			else if (strcmp (argv[i], "-W") == 0 || strcmp (argv[i], "--window") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					window = strtol (argv[i], invalid_int, BASE);
+					if (window < MIN_SIEVE_WINDOW || window > MAX_SIEVE_WINDOW || window % 64 || invalid_int)
+					{
+						fprintf (stderr, "Error: window size must be a valid multiple of 64 from %d to %d.\n", MIN_SIEVE_WINDOW, MAX_SIEVE_WINDOW);
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--check") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					check_name = argv[i];
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "-T") == 0 || strcmp (argv[i], "--table") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					table_name = argv[i];
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--autotune") == 0)
+			{
+				tune = TRUE;
+			}
+			else if (strcmp (argv[i], "--profile") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					profile_name = argv[i];
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--checkpoint") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					checkpoint_name = argv[i];
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--checkpoint-every") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					checkpoint_interval = strtol (argv[i], invalid_int, BASE);
+					if (checkpoint_interval <= 0 || invalid_int)
+					{
+						fprintf (stderr, "Error: checkpoint interval must be a valid number of seconds greater than 0.\n");
+						return EXIT_FAILURE;
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--resume") == 0)
 			{
-				mpz_clears (d, a, x, tmp, NULL);
-				return FALSE;
+				resume = TRUE;
 			}
-			if (!mpz_cmp (x, tmp)) // if (x == n - 1)
-				break;
-		}
-		if (r == s) // if the for loop completed
-		{
-			mpz_clears (d, a, x, tmp, NULL);
-			return FALSE;
-		}
-	}
-	mpz_clears (d, a, x, tmp, NULL);
-	return TRUE;
-}
-
-/* This method generates a random integer with a certain number of digits in the parameter n to be used as a starting point. */
-static void
-gen_start (mpz_t n, int num_digits, gmp_randstate_t random, pthread_mutex_t *rand_state_mutex)
-{
-	char s[num_digits + 1];
-	mpz_t tmp;
-	mpz_init (tmp);
-	
-	/* Set tmp = 45 followed by (num_digits - 2) zeroes. */
-	s[0] = '4';
-	s[1] = '5';
-	int i;
-	for (i = 2; i < num_digits; ++i)
-		s[i] = '0';
-	s[num_digits] = '\0';
-	mpz_set_str (tmp, (const char *)&s, BASE);
-	
-	pthread_mutex_lock (rand_state_mutex);
-	mpz_urandomm (n, random, tmp); // n in [0, 44999...]
-	pthread_mutex_unlock (rand_state_mutex);
-	mpz_mul_2exp (n, n, 1); // n *= 2 -> n in [0, 8999... - 1]
-	
-	/* Set tmp = 1 followed by (num_digits - 2) zeroes. */
-	s[0] = '1';
-	s[1] = '0';
-	s[i] = '\0'; // shorten string by one character
-	mpz_set_str (tmp, (const char *)&s, BASE);
-	
-	mpz_add (n, n, tmp); // n in [1000... , 999... - 1] (set of all even integers with specified number of digits)
-	mpz_add_ui (n, n, 1); // ++n
-	mpz_clear (tmp);
-}
-
-/* This function initializes the offsets from the starting point (a random odd integer with the specified number of digits). */
-static void
-offset_init (const mpz_t start_point, const long num_offsets, int *offsets)
-{
-	for (int i = 0; i < num_offsets; ++i)
-	{
-		/* First take the starting point mod each low prime, then use this value to find the offset. See readme for explanation. */
-		offsets[i] = (int)mpz_tdiv_ui (start_point, offset_primes[i]);
-		offsets[i] = (offsets[i] + (offsets[i] % 2) * offset_primes[i]) / 2;
-	}
-}
-
-/* This function updates the offsets after the test value has been incremented. */
-static void
-update_offsets (const long num_offsets, int *offsets)
-{
-	/* If the incremented offset is equal to the corresponding low prime, then it must be reset to 0. */
-	for (int i = 0; i < num_offsets; ++i)
-		if (++offsets[i] == offset_primes[i])
-			offsets[i] = 0;
-}
-
-/* This function, based on strlen, tests whether any of the offsets is equal to 0. */
-static enum boolean
-any_offset_equals_zero (const long num_offsets, const int *start_offset)
-{
-	int *current_offset = (int *)start_offset;
-	while (*current_offset) // loop until the value of current_offset is zero
-		++current_offset;
-	/* (current_offset - start_offset) will equal num_offsets if and only if none of the offsets equals 0. */
-	return ((current_offset - start_offset) != num_offsets);
-}
-
-/* This function finds the next odd number which should be tested. */
-static void
-next_test (mpz_t test_value, const long num_offsets, int *offsets)
-{
-	while (any_offset_equals_zero (num_offsets, offsets))
-	{
-		mpz_add_ui (test_value, test_value, 2); // next odd integer
-		update_offsets (num_offsets, offsets);
-	}
-}
-
-/* This method defines the behavior of each thread: find one prime and print it to the output file. */
-static void *
-find_prime (void *thread_args)
-{
-	struct thread_data_t *data = (struct thread_data_t *)thread_args;
-	enum boolean probably_prime;
-	mpz_t test_value;
-	mpz_init (test_value);
-	FILE *out_file;
-	
-	/* Creating the offsets as an int array and storing a 0 at the end allows
-	for the use of the function to test if any offsets are equal to 0. */
-	int offsets[data->num_offsets + 1];
-	offsets[data->num_offsets] = 0;
-	
-	/* Generate random starting position for search from the set of odd integers with the specified number of digits. */
-	gen_start (test_value, data->num_digits, data->random1, &data->rand_state_mutex1);
-	
-	/* Keeping track of the offsets from odd integers divisible by low prime numbers allows for skipping the
-	testing of odd numbers divisible by these low primes.  See readme for explanation of this principle. */
-	offset_init (test_value, data->num_offsets, offsets);
-	next_test (test_value, data->num_offsets, offsets);
-	probably_prime = miller_rabin (test_value, data->precision, data->random2, &data->rand_state_mutex2);
-	
-	while (!probably_prime)
-	{
-		mpz_add_ui (test_value, test_value, 2); // next odd integer
-		update_offsets (data->num_offsets, offsets);
-		next_test (test_value, data->num_offsets, offsets);
-		/* Moving the test to the end of the loop (which involves running the test once before the loop begins)
-		ensures that no part of the loop executes unnecessarily once a result of TRUE has already been returned. */
-		probably_prime = miller_rabin (test_value, data->precision, data->random2, &data->rand_state_mutex2);
-	}
-	
-	/* Increment and print current number of primes found. */
-	pthread_mutex_lock (&data->current_num_primes_mutex);
-	printf ("Prime #%ld found\n", ++data->current_num_primes);
-	pthread_mutex_unlock (&data->current_num_primes_mutex);
-	
-	/* Open output file, append prime, and close output file.  Opening and closing the output file each
-	time allows the program to be aborted without losing the primes which have already been found. */
-	pthread_mutex_lock (&data->out_file_mutex);
-	out_file = fopen (data->out_file_name_pointer, "a");
-	if (!out_file)
-	{
-		fprintf (stderr, "Error: failure to open output file.\n");
-		exit (EXIT_FAILURE);
-	}
-	gmp_fprintf (out_file, "%Zd\n", test_value);
-	fclose (out_file);
-	pthread_mutex_unlock (&data->out_file_mutex);
-	
-	mpz_clear (test_value);
-	pthread_exit (EXIT_SUCCESS);
-}
-
-/* Thus method prints the version number and a copyright message. */
-static void
-print_version ()
-{
-	printf ("\tMRPrimes %s\n", VERSION_NUMBER_STRING);
-	printf ("\tCopyright (C) 2012, 2013 Evan Brown\n");
-	printf ("\tLicense GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>\n");
-	printf ("\tThis is free software: you are free to change and redistribute it.\n");
-	printf ("\tThere is NO WARRANTY, to the extent permitted by law.\n");
-}
-
-/* This method prints a usage message. */
-static void
-print_help ()
-{
-	printf ("usage:\n");
-	printf ("\t-o set output file\n");
-	printf ("\t-n set number of primes to generate\n");
-	printf ("\t-d set number of digits of primes to generate\n");
-	printf ("\t-p set number of rounds of Miller-Rabin test to perform\n");
-	printf ("\t-O set number of offset primes to generate\n");
-	printf ("\t-s set random seed\n");
-	printf ("\t-a set whether to append output to an existing file\n");
-	printf ("\t-h print this help information\n");
-	printf ("\t-v print program version information\n");
-}
-
-/* The main method generates prime numbers based on the command line arguments. */
-int
-main (int argc, char *argv[])
-{
-	/* Set default argument values. */
-	char out_file_name[11] = "primes.txt";
-	char *out_file_name_pointer = out_file_name; // output file name (-o)
-	long num_digits = 300; // number of digits of primes to generate (-d)
-	long num_primes = 10; // number of primes to generate (-n)
-	long num_offsets = 10000; // number of offset primes (-O)
-	int precision = 8; // rounds of Miller-Rabin test to perform (-p)
-	uint64_t seed = (uint64_t)time (NULL); // random seed (-s)
-	enum boolean append = FALSE; // whether the program should try to append output to an existing file (-a)
-	
-	/* Set argument values and check for validity. */
-	if (argc > 1)
-	{
-		char **invalid_int = NULL; // for checking whether integer arguments are valid
-		
-		for (int i = 1; i < argc; ++i)
-		{
-			if (strcmp (argv[i], "-o") == 0 || strcmp (argv[i], "--output") == 0)
+			else if (strcmp (argv[i], "--timeout") == 0)
 			{
 				++i;
 				if (i < argc)
 				{
-					out_file_name_pointer = argv[i];
+					timeout = strtol (argv[i], invalid_int, BASE);
+					if (timeout <= 0 || timeout > UINT_MAX || invalid_int)
+					{
+						fprintf (stderr, "Error: timeout must be a valid number of seconds greater than 0.\n");
+						return EXIT_FAILURE;
+					}
 				}
 				else
 				{
@@ -331,15 +4753,15 @@ main (int argc, char *argv[])
 					return EXIT_FAILURE;
 				}
 			}
-			else if (strcmp (argv[i], "-O") == 0 || strcmp (argv[i], "--numoffsets") == 0)
+			else if (strcmp (argv[i], "--max-candidates") == 0)
 			{
 				++i;
 				if (i < argc)
 				{
-					num_offsets = strtol (argv[i], invalid_int, BASE);
-					if (num_offsets <= 0 || invalid_int)
+					max_candidates = strtol (argv[i], invalid_int, BASE);
+					if (max_candidates <= 0 || invalid_int)
 					{
-						fprintf (stderr, "Error: number of offset primes must be a valid integer greater than 0.\n");
+						fprintf (stderr, "Error: number of candidates must be a valid integer greater than 0.\n");
 						return EXIT_FAILURE;
 					}
 				}
@@ -349,15 +4771,31 @@ main (int argc, char *argv[])
 					return EXIT_FAILURE;
 				}
 			}
-			else if (strcmp (argv[i], "-n") == 0 || strcmp (argv[i], "--numprimes") == 0)
+			else if (strcmp (argv[i], "--coordinator") == 0 || strcmp (argv[i], "--worker") == 0)
 			{
 				++i;
 				if (i < argc)
 				{
-					num_primes = strtol (argv[i], invalid_int, BASE);
-					if (num_primes <= 0 || invalid_int)
+					if (strcmp (argv[i - 1], "--coordinator") == 0)
+						coordinator_port = argv[i];
+					else
+						node_address = argv[i];
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--shard-size") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					shard_size = strtol (argv[i], invalid_int, BASE);
+					if (shard_size <= 0 || invalid_int)
 					{
-						fprintf (stderr, "Error: number of primes must be a valid integer greater than 0.\n");
+						fprintf (stderr, "Error: shard size must be a valid integer greater than 0.\n");
 						return EXIT_FAILURE;
 					}
 				}
@@ -367,15 +4805,28 @@ main (int argc, char *argv[])
 					return EXIT_FAILURE;
 				}
 			}
-			else if (strcmp (argv[i], "-d") == 0 || strcmp (argv[i], "--numdigits") == 0)
+			else if (strcmp (argv[i], "--affinity") == 0)
 			{
 				++i;
 				if (i < argc)
 				{
-					num_digits = strtol (argv[i], invalid_int, BASE);
-					if (num_digits < 10 || invalid_int)
+					affinity = strcmp (argv[i], "none") == 0 ? NULL : argv[i];
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
+			}
+			else if (strcmp (argv[i], "--progress") == 0)
+			{
+				++i;
+				if (i < argc)
+				{
+					progress_interval = strtol (argv[i], invalid_int, BASE);
+					if (progress_interval <= 0 || invalid_int)
 					{
-						fprintf (stderr, "Error: number of digits must be a valid integer greater than or equal to 10.\n");
+						fprintf (stderr, "Error: number of seconds between progress reports must be a valid integer greater than 0.\n");
 						return EXIT_FAILURE;
 					}
 				}
@@ -385,19 +4836,25 @@ main (int argc, char *argv[])
 					return EXIT_FAILURE;
 				}
 			}
-			else if (strcmp (argv[i], "-s") == 0 || strcmp (argv[i], "--seed") == 0)
+			else if (strcmp (argv[i], "--bench") == 0)
+			{
+				bench = TRUE;
+			}
+			else if (strcmp (argv[i], "--bench-kernels") == 0)
+			{
+				bench_kernels = TRUE;
+			}
+			else if (strcmp (argv[i], "--bench-samples") == 0)
 			{
 				++i;
 				if (i < argc)
 				{
-					/* Create a temporary long int to test for a negative value. */
-					long seed_temp = strtol (argv[i], invalid_int, BASE);
-					if (seed_temp < 0 || invalid_int)
+					bench_samples = strtol (argv[i], invalid_int, BASE);
+					if (bench_samples <= 0 || invalid_int)
 					{
-						fprintf (stderr, "Error: seed value must be a valid long integer greater than or equal to 0.\n");
+						fprintf (stderr, "Error: number of samples must be a valid integer greater than 0.\n");
 						return EXIT_FAILURE;
 					}
-					seed = seed_temp;
 				}
 				else
 				{
@@ -405,15 +4862,18 @@ main (int argc, char *argv[])
 					return EXIT_FAILURE;
 				}
 			}
-			else if (strcmp (argv[i], "-p") == 0 || strcmp (argv[i], "--precision") == 0)
+			else if (strcmp (argv[i], "--bench-format") == 0)
 			{
 				++i;
 				if (i < argc)
 				{
-					precision = strtol (argv[i], invalid_int, BASE);
-					if (precision <= 0 || precision >= 200 || invalid_int)
+					if (strcmp (argv[i], "json") == 0)
+						bench_format = FALSE;
+					else if (strcmp (argv[i], "csv") == 0)
+						bench_format = TRUE;
+					else
 					{
-						fprintf (stderr, "Error: Miller Rabin test precision must be a valid integer greater than 0 and less than 200.\n");
+						fprintf (stderr, "Error: benchmark format must be json or csv.\n");
 						return EXIT_FAILURE;
 					}
 				}
@@ -423,9 +4883,44 @@ main (int argc, char *argv[])
 					return EXIT_FAILURE;
 				}
 			}
-			else if (strcmp (argv[i], "-a") == 0 || strcmp (argv[i], "--append") == 0)
+			else if (strcmp (argv[i], "--bench-digits") == 0 || strcmp (argv[i], "--bench-offsets") == 0 || strcmp (argv[i], "--bench-seeds") == 0)
 			{
-				append = TRUE;
+				++i;
+				if (i < argc)
+				{
+					/* The three lists are parsed the same way, so select the one named by the option. */
+					long **values = &bench_seeds, *count = &num_bench_seeds;
+					if (strcmp (argv[i - 1], "--bench-digits") == 0)
+					{
+						values = &bench_digits;
+						count = &num_bench_digits;
+					}
+					else if (strcmp (argv[i - 1], "--bench-offsets") == 0)
+					{
+						values = &bench_offsets;
+						count = &num_bench_offsets;
+					}
+					free (*values);
+					*count = parse_list (argv[i], values);
+					if (!*count)
+					{
+						fprintf (stderr, "Error: %s takes a comma separated list of valid integers greater than 0.\n", argv[i - 1]);
+						return EXIT_FAILURE;
+					}
+					for (long j = 0; values == &bench_digits && j < *count; ++j)
+					{
+						if ((*values)[j] < 10)
+						{
+							fprintf (stderr, "Error: number of digits must be a valid integer greater than or equal to 10.\n");
+							return EXIT_FAILURE;
+						}
+					}
+				}
+				else
+				{
+					fprintf (stderr, "Error: %s takes an argument. See readme for usage.\n", argv[i - 1]);
+					return EXIT_FAILURE;
+				}
 			}
 			else if (strcmp (argv[i], "-v") == 0 || strcmp (argv[i], "--version") == 0)
 			{
@@ -445,83 +4940,258 @@ main (int argc, char *argv[])
 		}
 	}
 	
+	/* The verdicts of the check mode go to standard output unless an output file was given, so that the default
+	output file, which may well be the file being checked, is not truncated. */
+	if (check_name && out_file_name_pointer == out_file_name)
+		out_file_name_pointer = "-";
+	status_out = strcmp (out_file_name_pointer, "-") == 0 ? stderr : stdout;
+	
+	/* A checkpoint records a position in the output file, so checkpointing needs an output file which can be truncated to it. */
+	if (checkpoint_name && (check_name || bench || bench_kernels || strcmp (out_file_name_pointer, "-") == 0))
+	{
+		fprintf (stderr, "Error: --checkpoint needs an output file, and cannot be used with --check, --bench or --bench-kernels.\n");
+		return EXIT_FAILURE;
+	}
+	if ((coordinator_port || node_address) && (checkpoint_name || check_name || bench || bench_kernels || (coordinator_port && node_address)))
+	{
+		fprintf (stderr, "Error: --coordinator and --worker cannot be used with each other, --checkpoint, --check, --bench or --bench-kernels.\n");
+		return EXIT_FAILURE;
+	}
+	if (resume && !checkpoint_name)
+	{
+		fprintf (stderr, "Error: --resume needs a checkpoint file given by --checkpoint.\n");
+		return EXIT_FAILURE;
+	}
+	
+	/* Run the benchmark instead of generating primes if requested. The matrix defaults to 100, 300 and 1000 digits
+	with 1000, 10000 and 100000 offset primes and seeds 1, 2 and 3. */
+	if (bench)
+	{
+		if (num_primes == LONG_MAX)
+		{
+			fprintf (stderr, "Error: --bench needs a number of primes greater than 0.\n");
+			return EXIT_FAILURE;
+		}
+		if (!num_bench_digits)
+			num_bench_digits = parse_list ("100,300,1000", &bench_digits);
+		if (!num_bench_offsets)
+			num_bench_offsets = parse_list ("1000,10000,100000", &bench_offsets);
+		if (!num_bench_seeds)
+			num_bench_seeds = parse_list ("1,2,3", &bench_seeds);
+		run_benchmark (bench_digits, num_bench_digits, bench_offsets, num_bench_offsets, bench_seeds, num_bench_seeds,
+			bench_format, num_primes, per_start, precision, prefilter, window, num_threads);
+		free (bench_digits);
+		free (bench_offsets);
+		free (bench_seeds);
+		return EXIT_SUCCESS;
+	}
+	
+	/* Run the kernel benchmark instead of generating primes if requested, with the same default digits and seeds. */
+	if (bench_kernels)
+	{
+		if (!num_bench_digits)
+			num_bench_digits = parse_list ("100,300,1000", &bench_digits);
+		if (!num_bench_seeds)
+			num_bench_seeds = parse_list ("1,2,3", &bench_seeds);
+		struct offset_table_t table;
+		table_init (&table, table_name, num_offsets, sieve_limit, window);
+		run_kernel_benchmark (bench_digits, num_bench_digits, bench_seeds, num_bench_seeds, bench_format, &table, num_offsets, sieve_limit,
+			bench_samples, precision, prefilter, format);
+		table_free (&table);
+		free (bench_digits);
+		free (bench_offsets);
+		free (bench_seeds);
+		return EXIT_SUCCESS;
+	}
+	
 	/* Get start time. */
 	timer ();
 	
+	/* Choose the number of offset primes and the window size for this machine if requested, overriding -O, -L and -W. */
+	if (tune)
+	{
+		autotune (profile_name, table_name, num_digits, num_bits, per_start, prefilter, &num_offsets, &window);
+		sieve_limit = 0;
+	}
+	
 	/* Initialize offset primes. */
-	offset_primes = malloc (num_offsets * sizeof (uint32_t));
-	init_offsets (num_offsets);
+	struct offset_table_t table;
+	table_init (&table, table_name, num_offsets, sieve_limit, window);
 	
-	/* Delete contents of output file unless user specified otherwise. */
-	if (!append)
+	/* Set up the pinning of the workers to processors if requested. */
+#ifdef __linux__
+	struct placement_t placement;
+	if (affinity && !placement_init (&placement, affinity, &table))
 	{
-		FILE *out_file = fopen (out_file_name_pointer, "w");
-		fclose (out_file);
+		fprintf (stderr, "Error: --affinity takes none, compact, scatter or a list of processors which the program may run on.\n");
+		return EXIT_FAILURE;
 	}
+#else
+	if (affinity)
+	{
+		fprintf (stderr, "Error: --affinity is only supported on Linux.\n");
+		return EXIT_FAILURE;
+	}
+#endif
 	
-	/* Initialize and set thread detached and stacksize attributes. */
-	pthread_attr_t attr;
-	pthread_attr_init (&attr);
-	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_JOINABLE);
-	pthread_attr_setstacksize (&attr, THREAD_STACKSIZE);
-	
-	/* Initialize thread arguments. */
-	struct thread_data_t thread_args = {num_digits, precision, num_offsets}; // num_digits, precision, num_offsets must be initialized immediately because they are const
-	thread_args.out_file_name_pointer = out_file_name_pointer;
-	gmp_randinit_mt (thread_args.random1);
-	gmp_randseed_ui (thread_args.random1, seed);
-	gmp_randinit_mt (thread_args.random2);
-	gmp_randseed_ui (thread_args.random2, seed);
-	thread_args.current_num_primes = 0;
-	pthread_mutex_init (&thread_args.out_file_mutex, NULL);
-	pthread_mutex_init (&thread_args.current_num_primes_mutex, NULL);
-	pthread_mutex_init (&thread_args.rand_state_mutex1, NULL);
-	pthread_mutex_init (&thread_args.rand_state_mutex2, NULL);
+	/* Stop searching on SIGINT or SIGTERM, on the SIGALRM of the timeout, and on the reader of the output going away instead
+	of being killed by SIGPIPE. The signals are blocked here so that only the writer, which unblocks them, can be interrupted by them. */
+	struct sigaction action = {0};
+	action.sa_handler = request_stop;
+	sigemptyset (&action.sa_mask);
+	sigaction (SIGINT, &action, NULL);
+	sigaction (SIGTERM, &action, NULL);
+	sigaction (SIGALRM, &action, NULL);
+	signal (SIGPIPE, SIG_IGN);
+	sigset_t signals;
+	sigemptyset (&signals);
+	sigaddset (&signals, SIGINT);
+	sigaddset (&signals, SIGTERM);
+	sigaddset (&signals, SIGALRM);
+	pthread_sigmask (SIG_BLOCK, &signals, NULL);
+	if (timeout)
+		alarm ((unsigned int)timeout);
 	
-	/* Print initialization time. */
-	if (CLOCK_PRECISION == 9)
-		printf ("Initialization time: %.9lf seconds.\n", timer ());
-	else
-		printf ("Initialization time: %.6lf seconds.\n", timer ());
+	/* Search the shards handed out by a coordinator if requested. A worker node has no output file of its own. */
+	if (node_address)
+	{
+		struct placement_t *node_placement = NULL;
+#ifdef __linux__
+		if (affinity)
+			node_placement = &placement;
+#endif
+		const enum boolean ended = run_node (node_address, &table, node_placement, num_threads);
+#ifdef __linux__
+		if (affinity)
+			placement_free (&placement);
+#endif
+		table_free (&table);
+		if (!ended)
+		{
+			fprintf (status_out, "Stopped by %s.\n", stop_reasons[atomic_load (&stop_requested) ? atomic_load (&stop_requested) : STOP_CLOSED]);
+			return EXIT_INCOMPLETE;
+		}
+		return EXIT_SUCCESS;
+	}
 	
-	/* Create one thread to find each prime. */
-	pthread_t threads[num_primes];
-	int return_code;
-	for (int i = 0; i < num_primes; ++i)
+	/* When resuming, take the seed from the checkpoint file, and drop any primes written after the checkpoint from the
+	output file, since they will be found again. */
+	struct checkpoint_t checkpoint;
+	if (checkpoint_name)
+		checkpoint_init (&checkpoint, checkpoint_name, checkpoint_interval);
+	if (resume)
 	{
-		return_code = pthread_create (&threads[i], &attr, find_prime, (void *)&thread_args);
-		if (return_code)
+		checkpoint_load (&checkpoint, &seed, num_digits, num_bits, per_start, num_primes, safe, format);
+		if (truncate (out_file_name_pointer, checkpoint.bytes))
 		{
-			fprintf (stderr, "Error: return code from pthread_create is %d\n", return_code);
+			fprintf (stderr, "Error: unable to truncate output file to the checkpoint.\n");
 			return EXIT_FAILURE;
 		}
+		append = TRUE;
 	}
 	
-	/* Free attribute and wait for the threads to finish. */
-	pthread_attr_destroy (&attr);
-	for (int i = 0; i < num_primes; ++i)
+	/* Open the output file, deleting its contents unless user specified otherwise, and start the writer. */
+	struct writer_t writer;
+	writer_start (&writer, out_file_name_pointer, append, sync_every, sync_ms);
+	
+	/* Check the candidates of a file instead of generating primes if requested. */
+	if (check_name)
 	{
-		return_code = pthread_join (threads[i], NULL);
-		if (return_code)
+		run_check (check_name, &table, &writer, format, precision, prefilter, test, seed, num_threads);
+		writer_finish (&writer);
+		table_free (&table);
+		if (atomic_load (&stop_requested))
 		{
-			fprintf (stderr, "Error: return code from pthread_join is %d\n", return_code);
-			return EXIT_FAILURE;
+			fprintf (status_out, "Stopped by %s.\n", stop_reasons[atomic_load (&stop_requested)]);
+			return EXIT_INCOMPLETE;
 		}
+		return EXIT_SUCCESS;
+	}
+	
+	/* Hand out the search to worker nodes instead of searching here if requested. */
+	if (coordinator_port)
+	{
+		run_coordinator (coordinator_port, &writer, format, shard_size, seed, num_digits, num_bits, per_start, num_primes, safe, test,
+			precision, prefilter);
+		writer_finish (&writer);
+		table_free (&table);
+		const int reason = atomic_load (&stop_requested);
+		if (reason)
+			fprintf (status_out, "Stopped by %s after writing %ld primes.\n", stop_reasons[reason], atomic_load (&writer.written));
+		return reason && num_primes != LONG_MAX ? EXIT_INCOMPLETE : EXIT_SUCCESS;
+	}
+	
+	/* Initialize thread arguments. */
+	struct thread_data_t thread_args = {num_digits, precision, &table, num_primes}; // num_digits, precision, table, num_primes must be initialized immediately because they are const
+	thread_args_init (&thread_args, prefilter, per_start, num_bits, seed);
+	thread_args.writer = &writer;
+	thread_args.format = format;
+	thread_args.safe = safe;
+	thread_args.test = test;
+	thread_args.max_candidates = max_candidates;
+#ifdef __linux__
+	if (affinity)
+		thread_args.placement = &placement;
+#endif
+	if (resume)
+	{
+		atomic_store (&thread_args.next_start_index, checkpoint.next_start_index);
+		atomic_store (&thread_args.current_num_primes, checkpoint.written);
+		atomic_store (&writer.written, checkpoint.written);
+	}
+	
+	/* Print initialization time. */
+	if (CLOCK_PRECISION == 9)
+		fprintf (status_out, "Initialization time: %.9lf seconds.\n", timer ());
+	else
+		fprintf (status_out, "Initialization time: %.6lf seconds.\n", timer ());
+	
+	/* Give the workers timers for the progress reporter to read if progress reports were requested. */
+	struct timer_set_t timers;
+	struct progress_t progress;
+	if (progress_interval)
+	{
+		timer_set_init (&timers, num_threads);
+		thread_args.timers = &timers;
+		progress_start (&progress, &timers, progress_interval);
+	}
+	
+	if (checkpoint_name)
+		checkpoint_start (&checkpoint, &thread_args, worker_count (&thread_args, num_threads));
+	run_workers (&thread_args, num_threads);
+	if (checkpoint_name)
+		checkpoint_finish (&checkpoint, atomic_load (&stop_requested) != 0);
+	
+	/* Stop the progress reporter and print the totals over all of the workers. */
+	if (progress_interval)
+	{
+		progress_finish (&progress);
+		fprintf (status_out, "Sieved %ld candidates, performed %ld Miller-Rabin tests and rejected %ld candidates.\n",
+			timer_total_count (&timers, COUNT_SIEVED), timer_total_count (&timers, COUNT_TESTS), timer_total_count (&timers, COUNT_REJECTED));
+		timer_set_free (&timers);
 	}
 	
+	/* Wait for the writer to write the last of the primes. */
+	writer_finish (&writer);
+	const int reason = atomic_load (&stop_requested);
+	if (reason)
+		fprintf (status_out, "Stopped by %s after writing %ld primes.\n", stop_reasons[reason], atomic_load (&writer.written));
+	
 	/* Get end time and print time taken. */
 	if (CLOCK_PRECISION == 9)
-		printf ("Execution time: %.9lf seconds.\n", timer ());
+		fprintf (status_out, "Execution time: %.9lf seconds.\n", timer ());
 	else
-		printf ("Execution time: %.6lf seconds.\n", timer ());
-	
-	/* Cleanup and exit. */
-	free (offset_primes);
-	gmp_randclear (thread_args.random1);
-	gmp_randclear (thread_args.random2);
-	pthread_mutex_destroy (&thread_args.out_file_mutex);
-	pthread_mutex_destroy (&thread_args.current_num_primes_mutex);
-	pthread_mutex_destroy (&thread_args.rand_state_mutex1);
-	pthread_mutex_destroy (&thread_args.rand_state_mutex2);
+		fprintf (status_out, "Execution time: %.6lf seconds.\n", timer ());
+	
+	/* Cleanup and exit. Stopping a run without a limit on the number of primes is its normal end. */
+#ifdef __linux__
+	if (affinity)
+		placement_free (&placement);
+#endif
+	table_free (&table);
+	mpz_clears (thread_args.start_low, thread_args.start_range, NULL);
+	if (reason && num_primes != LONG_MAX)
+		return EXIT_INCOMPLETE;
 	pthread_exit (EXIT_SUCCESS);
 }
+#endif
@@ -0,0 +1,55 @@
+/*
+MRPrimes - a program to generate large prime numbers using the Miller-Rabin probabalistic
+primality test implemented with the GNU Multiple Precision math library and POSIX threads.
+Copyright (C) 2012, 2013 Evan Brown
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The MRPrimes library generates and tests large probable primes in-process, with the same sieve and Miller-Rabin test as the
+program. A generator context owns the offset primes, the random streams and a pool of worker threads, so that one context can
+serve many requests without being set up again. Errors in allocating memory or starting threads end the process, as in the program. */
+
+#ifndef MRPRIMES_H
+#define MRPRIMES_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+typedef struct mrprimes_ctx mrprimes_ctx;
+
+/* Each prime found by mrprimes_generate is passed to a function of this type, along with its index among the primes of the
+request and the argument given to mrprimes_generate. It is called from the worker threads of the context, one call at a time,
+and the prime is only valid during the call. */
+typedef void (*mrprimes_callback) (const mpz_t prime, long index, void *arg);
+
+/* This function creates a generator context with a given number of offset primes (10000 if 0), worker threads (one per processor
+if 0) and randomized Miller-Rabin rounds per prime (8 if 0), whose random streams are derived from seed. It returns NULL if an
+argument is out of range. */
+mrprimes_ctx *mrprimes_create (long num_offsets, long num_threads, int rounds, uint64_t seed);
+
+/* This function finds count probable primes of exactly bits bits (at least 32) and passes each of them to callback, and returns
+once all of them have been passed, or returns -1 if an argument is out of range and 0 otherwise. Each request draws new random
+streams from the context, so a context created with the same seed serves the same primes for the same sequence of requests.
+Requests from several threads to one context are served one at a time. */
+int mrprimes_generate (mrprimes_ctx *ctx, long bits, long count, mrprimes_callback callback, void *arg);
+
+/* This function returns 1 if n is a probable prime, after trial division by the offset primes of the context and a base 2 round
+and the randomized rounds of the Miller-Rabin test, and 0 otherwise. It can be called from several threads at once. */
+int mrprimes_is_probable_prime (mrprimes_ctx *ctx, const mpz_t n);
+
+/* This function stops the worker threads of a context and frees it. */
+void mrprimes_destroy (mrprimes_ctx *ctx);
+
+#endif
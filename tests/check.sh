@@ -0,0 +1,67 @@
+#!/bin/sh
+# Checks run by "make check" on the program built by make, and on the same program built with -DMRPRIMES_GENERIC:
+#	- the verdicts of --check on the numbers of known.txt, which include strong pseudoprimes to several bases, for
+#	  --test mr and --test bpsw, with a single offset prime so that trial division settles none of them, which
+#	  exercises the test in machine words below 2^64 and the GMP test, and only the GMP test for the generic build;
+#	- the set of primes found with one worker thread and with several, which must be the same for the same seed;
+#	- a run stopped by the candidate budget and resumed from its checkpoint, which must find the same primes as a
+#	  run which was not stopped.
+# Usage: tests/check.sh [program...], where the programs default to ./mrprimes and ./mrprimes-generic.
+
+tests=$(dirname "$0")
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+[ $# -gt 0 ] || set -- ./mrprimes ./mrprimes-generic
+failures=0
+
+fail ()
+{
+	echo "FAIL: $*"
+	failures=$((failures + 1))
+}
+
+# The set of primes in two output files, which differ only in order between runs with different numbers of threads.
+same_primes ()
+{
+	sort "$1" > "$work/sorted1" && sort "$2" > "$work/sorted2" && cmp -s "$work/sorted1" "$work/sorted2"
+}
+
+cut -d ' ' -f 1 "$tests/known.txt" > "$work/known"
+for program in "$@"
+do
+	for test in mr bpsw
+	do
+		if ! "$program" --check "$work/known" --test $test -O 1 -s 1 -o "$work/verdicts" > /dev/null \
+			|| ! cmp -s "$work/verdicts" "$tests/known.txt"
+		then
+			fail "$program --test $test gives the wrong verdicts for known.txt"
+			diff "$work/verdicts" "$tests/known.txt"
+		fi
+	done
+
+	for options in "-d 200 -n 48" "-b 512 -n 12 --per-start 4" "-b 40 -n 2000 --per-start 100"
+	do
+		"$program" $options -s 11 -j 1 -o "$work/one" > /dev/null && "$program" $options -s 11 -j 3 -o "$work/several" > /dev/null \
+			&& same_primes "$work/one" "$work/several" || fail "$program $options finds other primes with -j 3 than with -j 1"
+	done
+
+	options="-d 300 -n 24 --per-start 6"
+	rm -f "$work/run.ckpt"
+	"$program" $options -s 13 -j 2 -o "$work/full" > /dev/null
+	"$program" $options -s 13 -j 1 -o "$work/resumed" --checkpoint "$work/run.ckpt" --max-candidates 600 > /dev/null
+	if [ $? -ne 2 ] || [ ! -f "$work/run.ckpt" ]
+	then
+		fail "$program $options --max-candidates 600 did not stop with a checkpoint"
+	elif ! "$program" $options -j 2 -o "$work/resumed" --checkpoint "$work/run.ckpt" --resume > /dev/null \
+		|| ! same_primes "$work/full" "$work/resumed" || [ -f "$work/run.ckpt" ]
+	then
+		fail "$program $options finds other primes when resumed from a checkpoint"
+	fi
+done
+
+if [ $failures -ne 0 ]
+then
+	echo "$failures checks failed."
+	exit 1
+fi
+echo "All checks passed."
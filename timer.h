@@ -17,6 +17,10 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <time.h>
 #include <sys/time.h>
 
@@ -30,7 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 /* Keep track of which of the two structs is from the last function call. */
-char state = -1; // -1 = first run state
+static char state = -1; // -1 = first run state
 
 /* This function gets the current time, and returns the difference from the last call. */
 static double
@@ -55,3 +59,136 @@ timer ()
 	state = !state; // -1,+1 -> 0; 0 -> +1
 	return dtime;
 }
+
+/* This function returns the current time in seconds. Unlike timer, it keeps no state, so it can be called from any thread. */
+static double
+timer_now ()
+{
+	#ifdef CLOCK_MONOTONIC
+		struct timespec now;
+		clock_gettime (CLOCK_MONOTONIC, &now);
+		return now.tv_sec + now.tv_nsec * 1e-9;
+	#else
+		struct timeval now;
+		gettimeofday (&now, NULL);
+		return now.tv_sec + now.tv_usec * 1e-6;
+	#endif
+}
+
+/* Limits of the per-thread timers. */
+enum timer_limits {TIMER_STAGES = 8, TIMER_COUNTERS = 8, TIMER_LINE_SIZE = 64};
+
+/* The following structure holds the lap timer, the time spent in each stage and the counters of one thread. Only the
+owning thread writes to it, and it starts on its own cache line so that threads updating their own timers never share
+a line. The counters are atomic so that another thread can read them while the run is in progress. */
+struct thread_timer_t
+{
+	_Alignas (TIMER_LINE_SIZE) double lap; // time at which the current stage began
+	double seconds[TIMER_STAGES];
+	atomic_long counts[TIMER_COUNTERS];
+};
+
+/* The following structure holds the timers of a group of threads, which claim one each. */
+struct timer_set_t
+{
+	struct thread_timer_t *threads;
+	long num_threads;
+	atomic_long next_thread; // index of the next timer to be claimed
+};
+
+/* This function sets every timer of a set to zero and makes all of them available to be claimed again. */
+static void
+timer_set_reset (struct timer_set_t *set)
+{
+	for (long i = 0; i < set->num_threads; ++i)
+	{
+		set->threads[i].lap = 0.0;
+		memset (set->threads[i].seconds, 0, sizeof (set->threads[i].seconds));
+		for (int j = 0; j < TIMER_COUNTERS; ++j)
+			atomic_init (&set->threads[i].counts[j], 0);
+	}
+	atomic_init (&set->next_thread, 0);
+}
+
+/* This function allocates the timers for a given number of threads. */
+static void
+timer_set_init (struct timer_set_t *set, long num_threads)
+{
+	void *memory;
+	if (posix_memalign (&memory, TIMER_LINE_SIZE, num_threads * sizeof (struct thread_timer_t)))
+	{
+		fprintf (stderr, "Error: failure to allocate timers.\n");
+		exit (EXIT_FAILURE);
+	}
+	set->threads = (struct thread_timer_t *)memory;
+	set->num_threads = num_threads;
+	timer_set_reset (set);
+}
+
+/* This function frees the timers of a set. */
+static void
+timer_set_free (struct timer_set_t *set)
+{
+	free (set->threads);
+}
+
+/* This function claims the next unclaimed timer of a set for the calling thread and starts its lap. */
+static struct thread_timer_t *
+timer_claim (struct timer_set_t *set)
+{
+	struct thread_timer_t *thread = &set->threads[atomic_fetch_add (&set->next_thread, 1)];
+	thread->lap = timer_now ();
+	return thread;
+}
+
+/* This function starts a new lap of a thread's timer without adding the time since the last lap to any stage. */
+static void
+timer_start (struct thread_timer_t *thread)
+{
+	thread->lap = timer_now ();
+}
+
+/* This function adds the time since the last lap to a stage and starts a new lap. */
+static void
+timer_lap (struct thread_timer_t *thread, int stage)
+{
+	double now = timer_now ();
+	thread->seconds[stage] += now - thread->lap;
+	thread->lap = now;
+}
+
+/* This function adds to one of a thread's counters. Since only the owning thread writes to its counters, a relaxed
+load and store is enough, and avoids the locked instruction of an atomic add. */
+static void
+timer_count (struct thread_timer_t *thread, int counter, long amount)
+{
+	long count = atomic_load_explicit (&thread->counts[counter], memory_order_relaxed);
+	atomic_store_explicit (&thread->counts[counter], count + amount, memory_order_relaxed);
+}
+
+/* This function sets one of a thread's counters. */
+static void
+timer_set_count (struct thread_timer_t *thread, int counter, long count)
+{
+	atomic_store_explicit (&thread->counts[counter], count, memory_order_relaxed);
+}
+
+/* This function returns the sum of a counter over all of the threads of a set. It can be called while the threads are running. */
+static long
+timer_total_count (struct timer_set_t *set, int counter)
+{
+	long total = 0;
+	for (long i = 0; i < set->num_threads; ++i)
+		total += atomic_load_explicit (&set->threads[i].counts[counter], memory_order_relaxed);
+	return total;
+}
+
+/* This function returns the time spent in a stage summed over all of the threads of a set. It must only be called once the threads are done. */
+static double
+timer_total_seconds (struct timer_set_t *set, int stage)
+{
+	double total = 0.0;
+	for (long i = 0; i < set->num_threads; ++i)
+		total += set->threads[i].seconds[stage];
+	return total;
+}